@@ -0,0 +1,76 @@
+#include "board_pose.h"
+
+#include <cmath>
+#include <opencv2/calib3d.hpp>
+
+namespace {
+
+const cv::TermCriteria refine_criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 10, 1e-8);
+
+}
+
+std::array<float, 9> BoardPose::to_array() const {
+    return {{valid ? 1.f : 0.f, warm_started ? 1.f : 0.f,
+             static_cast<float>(r_vec[0]), static_cast<float>(r_vec[1]), static_cast<float>(r_vec[2]),
+             static_cast<float>(t_vec[0]), static_cast<float>(t_vec[1]), static_cast<float>(t_vec[2]),
+             static_cast<float>(rms)}};
+}
+
+BoardPoseTracker::BoardPoseTracker(double max_rms):
+        max_rms(max_rms),
+        pose() {
+}
+
+void BoardPoseTracker::set_board(const std::vector<cv::Point3f>& board_points) {
+    board = board_points;
+    reset();
+}
+
+const BoardPose& BoardPoseTracker::track(const std::vector<cv::Point2f>& corners,
+                                         const cv::Mat& matrix, const cv::Mat& dist) {
+    if (corners.empty() || corners.size() != board.size()) {
+        pose.valid = false;
+        return pose;
+    }
+    if (camera_matrix.empty() || cv::norm(matrix, camera_matrix, cv::NORM_INF) != 0 ||
+        dist.total() != dist_coeffs.total() || (!dist.empty() && cv::norm(dist, dist_coeffs, cv::NORM_INF) != 0)) {
+        matrix.convertTo(camera_matrix, CV_64F);
+        dist.convertTo(dist_coeffs, CV_64F);
+        pose.valid = false;
+    }
+
+    if (pose.valid) {
+        cv::solvePnPRefineLM(board, corners, camera_matrix, dist_coeffs, pose.r_vec, pose.t_vec, refine_criteria);
+        pose.rms = reprojection_rms(corners);
+        pose.warm_started = true;
+        if (pose.rms <= max_rms)
+            return pose;
+    }
+
+    pose.valid = cv::solvePnP(board, corners, camera_matrix, dist_coeffs, pose.r_vec, pose.t_vec,
+                              false, cv::SOLVEPNP_IPPE);
+    if (pose.valid) {
+        cv::solvePnPRefineLM(board, corners, camera_matrix, dist_coeffs, pose.r_vec, pose.t_vec, refine_criteria);
+        pose.rms = reprojection_rms(corners);
+    }
+    pose.warm_started = false;
+    return pose;
+}
+
+const BoardPose& BoardPoseTracker::last() const {
+    return pose;
+}
+
+void BoardPoseTracker::reset() {
+    pose = BoardPose();
+}
+
+double BoardPoseTracker::reprojection_rms(const std::vector<cv::Point2f>& corners) {
+    cv::projectPoints(board, pose.r_vec, pose.t_vec, camera_matrix, dist_coeffs, projected);
+    double squared = 0;
+    for (size_t i = 0; i < corners.size(); ++i) {
+        cv::Point2f delta = projected[i] - corners[i];
+        squared += delta.dot(delta);
+    }
+    return std::sqrt(squared / corners.size());
+}
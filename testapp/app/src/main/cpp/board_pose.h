@@ -0,0 +1,46 @@
+#ifndef TESTAPP_BOARD_POSE_H
+#define TESTAPP_BOARD_POSE_H
+
+#include <array>
+#include <vector>
+#include <opencv2/core.hpp>
+
+struct BoardPose {
+    bool valid;
+    bool warm_started;
+    cv::Vec3d r_vec;
+    cv::Vec3d t_vec;
+    double rms;
+
+    // valid, warm_started, r_vec, t_vec, rms as floats for the JNI side.
+    std::array<float, 9> to_array() const;
+};
+
+// Per-frame 6-DoF pose of the planar board. While the board stays in view the
+// previous pose seeds solvePnPRefineLM directly; on the first frame, after a
+// miss, or when the warm-started fit is off by more than `max_rms` pixels
+// (e.g. a pose flip), it starts over from solvePnP with SOLVEPNP_IPPE.
+class BoardPoseTracker {
+
+public:
+    explicit BoardPoseTracker(double max_rms = 2.0);
+
+    void set_board(const std::vector<cv::Point3f>& board);
+    const BoardPose& track(const std::vector<cv::Point2f>& corners,
+                           const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs);
+    const BoardPose& last() const;
+    void reset();
+
+private:
+    double max_rms;
+    std::vector<cv::Point3f> board;
+    BoardPose pose;
+    // Intrinsics converted once per calibration rather than per frame.
+    cv::Mat camera_matrix;
+    cv::Mat dist_coeffs;
+    std::vector<cv::Point2f> projected;
+
+    double reprojection_rms(const std::vector<cv::Point2f>& corners);
+};
+
+#endif //TESTAPP_BOARD_POSE_H
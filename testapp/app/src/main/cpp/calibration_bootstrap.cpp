@@ -0,0 +1,142 @@
+#include "calibration_bootstrap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+
+#include "sparse_calibration_solver.h"
+#include "thread_pool.h"
+
+namespace {
+
+const char* parameter_names[] = {"fx", "fy", "cx", "cy", "k1", "k2", "p1", "p2", "k3"};
+const int parameter_count = 9;
+
+bool parameters_of(const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs, double* values) {
+    cv::Mat k, dist;
+    camera_matrix.convertTo(k, CV_64F);
+    values[0] = k.at<double>(0, 0);
+    values[1] = k.at<double>(1, 1);
+    values[2] = k.at<double>(0, 2);
+    values[3] = k.at<double>(1, 2);
+    if (!dist_coeffs.empty())
+        dist_coeffs.reshape(1, static_cast<int>(dist_coeffs.total())).convertTo(dist, CV_64F);
+    for (int i = 0; i < 5; ++i)
+        values[4 + i] = i < dist.rows ? dist.at<double>(i) : 0.0;
+    for (int i = 0; i < parameter_count; ++i)
+        if (!std::isfinite(values[i]))
+            return false;
+    return true;
+}
+
+double quantile(const std::vector<double>& sorted, double q) {
+    double position = q * (sorted.size() - 1);
+    size_t below = static_cast<size_t>(position);
+    size_t above = std::min(below + 1, sorted.size() - 1);
+    return sorted[below] + (position - below) * (sorted[above] - sorted[below]);
+}
+
+}
+
+bool BootstrapResult::needs_more_views(double tolerance) const {
+    if (parameters.size() < 4 || samples - failed < 2)
+        return true;
+    double focal = std::max(parameters[0].estimate, parameters[1].estimate);
+    for (int i = 0; i < 4; ++i)
+        if (parameters[i].upper - parameters[i].lower > tolerance * focal)
+            return true;
+    return false;
+}
+
+std::vector<double> BootstrapResult::to_array() const {
+    std::vector<double> values {static_cast<double>(samples), static_cast<double>(failed), confidence, seconds,
+                                needs_more_views() ? 1.0 : 0.0};
+    for (const ParameterInterval& parameter : parameters) {
+        values.push_back(parameter.estimate);
+        values.push_back(parameter.lower);
+        values.push_back(parameter.upper);
+        values.push_back(parameter.std_dev);
+    }
+    return values;
+}
+
+BootstrapResult bootstrap_calibration(const std::vector<cv::Point3f>& board,
+                                      const std::vector<std::vector<cv::Point2f> >& views,
+                                      const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs,
+                                      int samples, double confidence, uint64_t seed) {
+    auto start = std::chrono::steady_clock::now();
+    BootstrapResult result;
+    result.samples = std::max(0, samples);
+    result.failed = 0;
+    result.confidence = confidence;
+
+    double estimate[parameter_count];
+    parameters_of(camera_matrix, dist_coeffs, estimate);
+
+    // Warm-started solves converge in a few iterations; the views of one
+    // sample stay on one thread so samples, not views, are what run in parallel.
+    SparseCalibrationSolver::Options options;
+    options.max_iterations = 20;
+    options.parallel = false;
+    SparseCalibrationSolver solver(options);
+
+    std::vector<double> draws(static_cast<size_t>(result.samples) * parameter_count);
+    std::vector<char> valid(result.samples, 0);
+    std::atomic<int> next_sample(0);
+    auto drain = [&] {
+        int sample;
+        std::vector<std::vector<cv::Point2f> > resampled(views.size());
+        while ((sample = next_sample.fetch_add(1)) < result.samples) {
+            // Seeded per sample, so the result does not depend on scheduling.
+            cv::RNG rng(seed * 0x9E3779B97F4A7C15ULL + static_cast<uint64_t>(sample) + 1);
+            for (std::vector<cv::Point2f>& view : resampled)
+                view = views[rng.uniform(0, static_cast<int>(views.size()))];
+            try {
+                SparseCalibrationResult solved = solver.solve(board, resampled, camera_matrix, dist_coeffs);
+                valid[sample] = parameters_of(solved.camera_matrix, solved.dist_coeffs, &draws[sample * parameter_count]);
+            } catch (const cv::Exception&) {
+                valid[sample] = 0;
+            }
+        }
+    };
+
+    std::shared_ptr<ThreadPool> pool = ThreadPool::shared();
+    std::vector<std::future<void> > helpers;
+    if (!views.empty()) {
+        for (int i = 0; i < pool->workers(Lane::Background); ++i)
+            helpers.push_back(pool->submit(Lane::Background, drain));
+        pool->parallel_for_(Lane::Latency, cv::Range(0, pool->workers(Lane::Latency) + 1),
+                            [&](const cv::Range&) { drain(); });
+    }
+    // The helpers reference locals: all of them must be done before returning.
+    for (std::future<void>& helper : helpers)
+        helper.wait();
+
+    double tail = (1.0 - confidence) / 2;
+    std::vector<double> values;
+    for (int p = 0; p < parameter_count; ++p) {
+        values.clear();
+        for (int sample = 0; sample < result.samples; ++sample)
+            if (valid[sample])
+                values.push_back(draws[sample * parameter_count + p]);
+        ParameterInterval interval {parameter_names[p], estimate[p], estimate[p], estimate[p], 0.0};
+        if (values.size() >= 2) {
+            std::sort(values.begin(), values.end());
+            interval.lower = quantile(values, tail);
+            interval.upper = quantile(values, 1.0 - tail);
+            double mean = 0, squared = 0;
+            for (double value : values)
+                mean += value;
+            mean /= values.size();
+            for (double value : values)
+                squared += (value - mean) * (value - mean);
+            interval.std_dev = std::sqrt(squared / (values.size() - 1));
+        }
+        result.parameters.push_back(interval);
+    }
+    result.failed = static_cast<int>(std::count(valid.begin(), valid.end(), 0));
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
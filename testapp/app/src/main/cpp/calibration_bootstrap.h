@@ -0,0 +1,42 @@
+#ifndef TESTAPP_CALIBRATION_BOOTSTRAP_H
+#define TESTAPP_CALIBRATION_BOOTSTRAP_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core.hpp>
+
+struct ParameterInterval {
+    const char* name;
+    double estimate;
+    double lower;
+    double upper;
+    double std_dev;
+};
+
+struct BootstrapResult {
+    // fx, fy, cx, cy, k1, k2, p1, p2, k3
+    std::vector<ParameterInterval> parameters;
+    int samples;
+    int failed;
+    double confidence;
+    double seconds;
+
+    // True when the focal length or principal point interval is wider than
+    // `tolerance` of the focal length, i.e. more varied snapshots would help.
+    bool needs_more_views(double tolerance = 0.01) const;
+    // samples, failed, confidence, seconds, needs_more_views, then
+    // estimate, lower, upper, std_dev for each parameter.
+    std::vector<double> to_array() const;
+};
+
+// Percentile bootstrap over views: each sample draws views with replacement
+// and re-solves with SparseCalibrationSolver, warm-started from the given
+// solution. Samples are spread over every worker of both thread pool lanes
+// plus the calling thread. Only the k1, k2, p1, p2, k3 model is resampled;
+// higher-order coefficients of the input are ignored.
+BootstrapResult bootstrap_calibration(const std::vector<cv::Point3f>& board,
+                                      const std::vector<std::vector<cv::Point2f> >& views,
+                                      const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs,
+                                      int samples = 200, double confidence = 0.95, uint64_t seed = 1);
+
+#endif //TESTAPP_CALIBRATION_BOOTSTRAP_H
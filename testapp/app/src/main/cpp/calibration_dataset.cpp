@@ -0,0 +1,172 @@
+#include "calibration_dataset.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char dataset_magic[8] = {'C', 'A', 'L', 'D', 'A', 'T', 'A', '1'};
+const uint32_t dataset_version = 2;
+// Version 1 had no target pattern field.
+const size_t fixed_header_bytes = sizeof(dataset_magic) + 9 * sizeof(uint32_t);
+const size_t fixed_header_bytes_v1 = fixed_header_bytes - sizeof(uint32_t);
+
+// Byte-wise so the files are the same whatever the host's byte order.
+class Encoder {
+
+public:
+    explicit Encoder(FILE* file):
+            file(file) {}
+
+    void u32(uint32_t value) {
+        uint8_t bytes[4];
+        for (int i = 0; i < 4; ++i)
+            bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+        fwrite(bytes, 1, sizeof(bytes), file);
+    }
+    void i64(int64_t value) {
+        uint64_t bits = static_cast<uint64_t>(value);
+        u32(static_cast<uint32_t>(bits));
+        u32(static_cast<uint32_t>(bits >> 32));
+    }
+    void f32(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        u32(bits);
+    }
+
+private:
+    FILE* file;
+};
+
+class Decoder {
+
+public:
+    explicit Decoder(const uint8_t* data):
+            data(data) {}
+
+    uint32_t u32() {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i)
+            value |= static_cast<uint32_t>(data[i]) << (8 * i);
+        data += 4;
+        return value;
+    }
+    int64_t i64() {
+        uint64_t low = u32();
+        uint64_t high = u32();
+        return static_cast<int64_t>(low | high << 32);
+    }
+    float f32() {
+        uint32_t bits = u32();
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    const uint8_t* data;
+};
+
+}
+
+bool CalibrationDataset::save(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    Encoder out(file);
+    fwrite(dataset_magic, 1, sizeof(dataset_magic), file);
+    out.u32(dataset_version);
+    out.u32(static_cast<uint32_t>(board_size.width));
+    out.u32(static_cast<uint32_t>(board_size.height));
+    out.u32(static_cast<uint32_t>(square_size));
+    out.u32(static_cast<uint32_t>(pattern));
+    out.u32(static_cast<uint32_t>(image_size.width));
+    out.u32(static_cast<uint32_t>(image_size.height));
+    out.u32(static_cast<uint32_t>(views.size()));
+    out.u32(static_cast<uint32_t>(device.size()));
+    fwrite(device.data(), 1, device.size(), file);
+
+    size_t corners = static_cast<size_t>(board_size.area());
+    for (const DatasetView& view : views) {
+        out.i64(view.timestamp_ns);
+        out.f32(view.quality);
+        for (size_t i = 0; i < corners; ++i) {
+            cv::Point2f corner = i < view.corners.size() ? view.corners[i] : cv::Point2f();
+            out.f32(corner.x);
+            out.f32(corner.y);
+        }
+    }
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+bool CalibrationDataset::load(const std::string& path, CalibrationDataset& dataset) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void* address = MAP_FAILED;
+    size_t bytes = 0;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= fixed_header_bytes_v1) {
+        bytes = static_cast<size_t>(info.st_size);
+        address = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (address == MAP_FAILED)
+        return false;
+    const uint8_t* begin = static_cast<const uint8_t*>(address);
+    madvise(address, bytes, MADV_SEQUENTIAL);
+
+    bool valid = std::memcmp(begin, dataset_magic, sizeof(dataset_magic)) == 0;
+    Decoder in(begin + sizeof(dataset_magic));
+    CalibrationDataset loaded;
+    uint32_t version = in.u32();
+    bool has_pattern = version != 1;
+    valid = valid && (!has_pattern || (version == dataset_version && bytes >= fixed_header_bytes));
+    size_t header_bytes = has_pattern ? fixed_header_bytes : fixed_header_bytes_v1;
+    loaded.board_size.width = static_cast<int>(in.u32());
+    loaded.board_size.height = static_cast<int>(in.u32());
+    loaded.square_size = static_cast<int>(in.u32());
+    // Not read from short files: the header reads stay inside the mapping.
+    uint32_t pattern = has_pattern && valid ? in.u32() : 0;
+    valid = valid && pattern <= static_cast<uint32_t>(TargetPattern::AsymmetricCircles);
+    loaded.pattern = static_cast<TargetPattern>(pattern);
+    loaded.image_size.width = static_cast<int>(in.u32());
+    loaded.image_size.height = static_cast<int>(in.u32());
+    uint64_t view_count = in.u32();
+    uint64_t device_bytes = in.u32();
+    uint64_t corners = static_cast<uint64_t>(loaded.board_size.width) * static_cast<uint64_t>(loaded.board_size.height);
+    uint64_t view_bytes = 12 + corners * 8;
+    valid = valid && loaded.board_size.width > 0 && loaded.board_size.height > 0
+            && corners < bytes && header_bytes + device_bytes + view_count * view_bytes == bytes;
+
+    if (valid) {
+        loaded.device.assign(reinterpret_cast<const char*>(in.data), device_bytes);
+        in.data += device_bytes;
+        loaded.views.resize(view_count);
+        for (DatasetView& view : loaded.views) {
+            view.timestamp_ns = in.i64();
+            view.quality = in.f32();
+            view.corners.resize(corners);
+            for (cv::Point2f& corner : view.corners) {
+                corner.x = in.f32();
+                corner.y = in.f32();
+            }
+        }
+        dataset = std::move(loaded);
+    }
+    munmap(address, bytes);
+    return valid;
+}
+
+std::vector<std::vector<cv::Point2f> > CalibrationDataset::image_points() const {
+    std::vector<std::vector<cv::Point2f> > points;
+    points.reserve(views.size());
+    for (const DatasetView& view : views)
+        points.push_back(view.corners);
+    return points;
+}
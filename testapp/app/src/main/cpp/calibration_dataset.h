@@ -0,0 +1,46 @@
+#ifndef TESTAPP_CALIBRATION_DATASET_H
+#define TESTAPP_CALIBRATION_DATASET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "calibration_target.h"
+
+struct DatasetView {
+    int64_t timestamp_ns;   // steady clock when the snapshot was accepted
+    float quality;          // share of the frame covered by the board's outline
+    std::vector<cv::Point2f> corners;
+};
+
+// The corners collected in a session, enough to re-run calibrate() offline.
+//
+// File layout, little-endian: "CALDATA1", u32 version, u32 board width and
+// height, u32 square size, u32 target pattern, u32 image width and height,
+// u32 view count, u32 device name length and the name; then per view an i64 timestamp, an f32
+// quality and board width * height (x, y) f32 pairs. Views have a fixed size,
+// so a reader can map the file and index them directly. Version 1 files,
+// without the pattern, are chessboards.
+struct CalibrationDataset {
+    cv::Size board_size;
+    int square_size;
+    TargetPattern pattern;
+    cv::Size image_size;
+    std::string device;
+    std::vector<DatasetView> views;
+
+    CalibrationDataset():
+            square_size(0),
+            pattern(TargetPattern::Chessboard)
+            {};
+
+    // Streams the views out one at a time.
+    bool save(const std::string& path) const;
+    // Maps the file and decodes it; false for truncated or foreign files.
+    static bool load(const std::string& path, CalibrationDataset& dataset);
+
+    std::vector<std::vector<cv::Point2f> > image_points() const;
+};
+
+#endif //TESTAPP_CALIBRATION_DATASET_H
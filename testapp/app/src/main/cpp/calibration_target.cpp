@@ -0,0 +1,85 @@
+#include "calibration_target.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+std::vector<cv::Point3f> target_object_points(TargetPattern pattern, const cv::Size& board, float spacing) {
+    std::vector<cv::Point3f> points;
+    points.reserve(board.area());
+    for (int i = 0; i < board.height; ++i)
+        for (int j = 0; j < board.width; ++j) {
+            float column = pattern == TargetPattern::AsymmetricCircles ? static_cast<float>(2 * j + i % 2)
+                                                                       : static_cast<float>(j);
+            points.emplace_back(column * spacing, i * spacing, 0.f);
+        }
+    return points;
+}
+
+CircleGridDetector::CircleGridDetector(const Options& options):
+        options(options),
+        flags(cv::CALIB_CB_SYMMETRIC_GRID) {
+}
+
+void CircleGridDetector::configure(TargetPattern pattern, const cv::Size& board, const cv::Size& image) {
+    blob_detectors.clear();
+    board_size = board;
+    if (pattern == TargetPattern::Chessboard || board.area() <= 0 || image.area() <= 0)
+        return;
+    bool asymmetric = pattern == TargetPattern::AsymmetricCircles;
+    flags = asymmetric ? cv::CALIB_CB_ASYMMETRIC_GRID : cv::CALIB_CB_SYMMETRIC_GRID;
+
+    // Board extent in centre spacings, and the distance to the nearest circle.
+    double span_x = asymmetric ? 2 * board.width - 1 : board.width - 1;
+    double span_y = std::max(board.height - 1, 1);
+    double neighbour = asymmetric ? std::sqrt(2.0) : 1.0;
+    // Filling the frame in either orientation.
+    double max_spacing = std::max(std::min(image.width / span_x, image.height / span_y),
+                                  std::min(image.width / span_y, image.height / span_x));
+    double min_spacing = max_spacing * options.min_board_fraction;
+
+    for (int level = 0; level <= max_level; ++level) {
+        double scale = 1.0 / (1 << level);
+        double min_diameter = min_spacing * neighbour * options.min_diameter * scale;
+        double max_diameter = max_spacing * neighbour * options.max_diameter * scale;
+        cv::SimpleBlobDetector::Params params;
+        params.minThreshold = 40;
+        params.maxThreshold = 220;
+        params.thresholdStep = static_cast<float>(options.threshold_step);
+        params.filterByColor = true;
+        params.blobColor = 0;
+        params.filterByArea = true;
+        params.minArea = static_cast<float>(std::max(CV_PI / 4 * min_diameter * min_diameter, 4.0));
+        params.maxArea = static_cast<float>(std::max(CV_PI / 4 * max_diameter * max_diameter, 16.0));
+        params.filterByCircularity = true;
+        params.minCircularity = options.min_circularity;
+        params.filterByConvexity = true;
+        params.minConvexity = 0.8f;
+        params.filterByInertia = true;
+        params.minInertiaRatio = 0.1f;
+        // Below the closest centre distance, or neighbouring circles merge.
+        params.minDistBetweenBlobs = static_cast<float>(std::max(min_spacing * neighbour * scale / 2, 1.0));
+        blob_detectors.push_back(cv::SimpleBlobDetector::create(params));
+    }
+}
+
+bool CircleGridDetector::configured() const {
+    return !blob_detectors.empty();
+}
+
+bool CircleGridDetector::detect(const cv::Mat& gray, std::vector<cv::Point2f>& centers, int level) const {
+    centers.clear();
+    if (!configured())
+        return false;
+    level = std::min(std::max(level, 0), max_level);
+    cv::Mat small = gray;
+    for (int i = 0; i < level; ++i)
+        cv::pyrDown(small, small);
+    cv::Ptr<cv::FeatureDetector> blobs = blob_detectors[level];
+    bool found = cv::findCirclesGrid(small, board_size, centers, flags, blobs);
+    float scale = static_cast<float>(1 << level);
+    for (cv::Point2f& center : centers)
+        center *= scale;
+    return found;
+}
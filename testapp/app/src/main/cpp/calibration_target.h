@@ -0,0 +1,65 @@
+#ifndef TESTAPP_CALIBRATION_TARGET_H
+#define TESTAPP_CALIBRATION_TARGET_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+// The board printed for calibration. Circle grids follow findCirclesGrid's
+// layout: the size counts circles per row and rows, and the asymmetric grid
+// offsets every other row by half a column, so its columns are two spacings apart.
+enum class TargetPattern {
+    Chessboard,
+    SymmetricCircles,
+    AsymmetricCircles
+};
+
+// Board points in the order the detectors return them, `spacing` apart, on z = 0.
+std::vector<cv::Point3f> target_object_points(TargetPattern pattern, const cv::Size& board, float spacing);
+
+// findCirclesGrid with one SimpleBlobDetector per pyramid level, built once
+// per board and frame size instead of a default one per frame. The blob area
+// and spacing limits follow from the pixel size the circles can have: the
+// board at most fills the frame and is at least `min_board_fraction` of that
+// size, with circle diameters between `min_diameter` and `max_diameter` of
+// the distance between neighbouring centres. Fewer threshold steps than the
+// default and the narrow limits keep the blob pass cheap. Detection is const
+// and the blob detectors keep no per-call state, so parallel detection
+// workers share one instance.
+class CircleGridDetector {
+
+public:
+    struct Options {
+        double min_board_fraction;
+        double min_diameter;
+        double max_diameter;
+        float min_circularity;  // low enough for circles seen at an angle
+        int threshold_step;
+
+        Options():
+                min_board_fraction(0.15),
+                min_diameter(0.25),
+                max_diameter(0.8),
+                min_circularity(0.6f),
+                threshold_step(20)
+                {};
+    };
+
+    static const int max_level = 3;
+
+    explicit CircleGridDetector(const Options& options = Options());
+
+    void configure(TargetPattern pattern, const cv::Size& board, const cv::Size& image);
+    bool configured() const;
+    // Finds the grid in `gray` shrunk by 2^level (clamped to max_level);
+    // centres come back in full resolution coordinates.
+    bool detect(const cv::Mat& gray, std::vector<cv::Point2f>& centers, int level) const;
+
+private:
+    Options options;
+    cv::Size board_size;
+    int flags;
+    std::vector<cv::Ptr<cv::SimpleBlobDetector> > blob_detectors;
+};
+
+#endif //TESTAPP_CALIBRATION_TARGET_H
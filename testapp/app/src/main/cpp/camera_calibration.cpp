@@ -1,64 +1,630 @@
 #include "camera_calibration.h"
 
+#include <limits>
+
+namespace {
+
+struct DetectionQuality {
+    int detect_interval;    // run detection on every n-th frame
+    int pyramid_level;      // find the board on a 2^level times smaller image
+};
+
+// Frame scheduler levels, cheapest last.
+const DetectionQuality detection_levels[] = {{1, 0}, {1, 1}, {2, 1}, {3, 2}};
+const int remap_interpolation[] = {cv::INTER_LINEAR, cv::INTER_NEAREST};
+
+// Room around a snapshot's board for the deferred refinement window, and the
+// most crop memory kept before snapshots fall back to full live refinement.
+const int snapshot_crop_margin = 24;
+const size_t max_crop_bytes = 64 << 20;
+
+// Area inside the board's outer corners over the frame area.
+float board_coverage(const std::vector<cv::Point2f>& corners, const cv::Size& board, const cv::Size& image) {
+    if (image.area() <= 0 || corners.size() != static_cast<size_t>(board.area()))
+        return 0;
+    std::vector<cv::Point2f> outline {corners[0], corners[board.width - 1], corners.back(),
+                                      corners[corners.size() - board.width]};
+    return static_cast<float>(cv::contourArea(outline) / image.area());
+}
+
+// Without an intrinsic guess in `flags`, starts from fisheye::calibrate's own
+// initialisation. Skew stays fixed and the board poses are re-estimated on
+// every iteration, which the equidistant model needs to converge reliably.
+double calibrate_fisheye(const std::vector<std::vector<cv::Point3f> >& object_points,
+                         const std::vector<std::vector<cv::Point2f> >& views, const cv::Size& size,
+                         cv::Mat& matrix, cv::Mat& dist, int flags, int iterations) {
+    if (!(flags & cv::fisheye::CALIB_USE_INTRINSIC_GUESS)) {
+        matrix = cv::Mat::eye(3, 3, CV_64F);
+        dist = cv::Mat::zeros(4, 1, CV_64F);
+    }
+    return cv::fisheye::calibrate(object_points, views, size, matrix, dist, cv::noArray(), cv::noArray(),
+                                  flags | cv::fisheye::CALIB_RECOMPUTE_EXTRINSIC | cv::fisheye::CALIB_FIX_SKEW,
+                                  cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, iterations, 1e-6));
+}
+
+FrameScheduler::Options scheduler_levels(int levels) {
+    FrameScheduler::Options options;
+    options.levels = levels;
+    return options;
+}
+
+}
+
 void CameraCalibration::set_sizes(const cv::Size& board, const cv::Size& image, const int square) {
     board_size = board;
     image_size = image;
     square_size = square;
+    corners.reserve(board.area());
+    image_points.reserve(max_views);
+    pose_tracker.set_board(object_points_for_views(1)[0]);
+    std::shared_ptr<CircleGridDetector> circles = std::make_shared<CircleGridDetector>();
+    circles->configure(target, board_size, image_size);
+    std::lock_guard<std::mutex> lock(detection_mutex);
+    circle_detector = circles;
+}
+
+void CameraCalibration::set_target(TargetPattern pattern) {
+    std::lock_guard<std::mutex> frame_lock(frame_mutex);
+    if (pattern == target)
+        return;
+    target = pattern;
+    // Views of another target do not fit this one's object points.
+    clear_views();
+    corners_found = false;
+    if (board_size.area() > 0)
+        set_sizes(board_size, image_size, square_size);
+    // Detections in flight were made for the old target.
+    if (detector)
+        reset_detector(detector->workers());
+}
+
+void CameraCalibration::clear_views() {
+    image_points.clear();
+    snapshot_crops.clear();
+    crop_bytes = 0;
+    snapshot_times.clear();
+    snapshot_quality.clear();
+}
+
+TargetPattern CameraCalibration::target_pattern() const {
+    return target;
+}
+
+bool CameraCalibration::set_snapshot_output(const std::string& directory, const SnapshotWriter::Options& options) {
+    snapshot_writer.stop();
+    return directory.empty() || snapshot_writer.start(directory, options);
+}
+
+SnapshotWriter::Stats CameraCalibration::snapshot_output_stats() const {
+    return snapshot_writer.stats();
+}
+
+void CameraCalibration::set_solver(CalibrationSolver calibration_solver, size_t view_limit) {
+    solver = calibration_solver;
+    max_views = view_limit;
+    image_points.reserve(max_views);
+}
+
+void CameraCalibration::set_lens_model(LensModel model, double balance, double fov_scale) {
+    lens_model = model;
+    fisheye_balance = std::min(std::max(balance, 0.0), 1.0);
+    fisheye_fov_scale = fov_scale > 0 ? fov_scale : 1.0;
+}
+
+LensModel CameraCalibration::lens() const {
+    return lens_model;
+}
+
+void CameraCalibration::set_detection_workers(int workers) {
+    std::lock_guard<std::mutex> frame_lock(frame_mutex);
+    reset_detector(workers);
+}
+
+void CameraCalibration::reset_detector(int workers) {
+    if (workers <= 1) {
+        detector.reset();
+        return;
+    }
+    detector.reset(new ParallelDetector(workers, [this](const cv::Mat& worker_gray, std::vector<cv::Point2f>& found,
+                                                        Refinement refinement) {
+        return detect_corners(worker_gray, found, detection_levels[detect_scheduler.level()].pyramid_level, refinement);
+    }, stats, &arena));
+}
+
+void CameraCalibration::set_frame_budget(std::chrono::microseconds budget) {
+    stats.set_frame_budget(budget);
+    detect_scheduler.set_budget(budget);
+    remap_scheduler.set_budget(budget);
+}
+
+void CameraCalibration::set_adaptive_quality(bool enabled) {
+    detect_scheduler.set_enabled(enabled);
+    remap_scheduler.set_enabled(enabled);
+}
+
+void CameraCalibration::convert_gray(const cv::Mat& frame, cv::Mat& out) {
+    StageTimer timer(stats, Stage::Gray);
+    out.create(frame.size(), CV_8UC1);
+    ThreadPool::shared()->parallel_for_(Lane::Latency, cv::Range(0, frame.rows), [&](const cv::Range& rows) {
+        cv::Mat gray_rows = out.rowRange(rows);
+        cvtColor(frame.rowRange(rows), gray_rows, cv::COLOR_BGR2GRAY);
+    });
+}
+
+bool CameraCalibration::detect_corners(const cv::Mat& image, std::vector<cv::Point2f>& found, int pyramid_level,
+                                       Refinement refinement) {
+    DetectionConfig config;
+    std::shared_ptr<const CircleGridDetector> circles;
+    {
+        std::lock_guard<std::mutex> lock(detection_mutex);
+        config = detection;
+        circles = circle_detector;
+    }
+    // The scheduler can only make detection coarser than the tuned level.
+    pyramid_level = std::max(pyramid_level, config.pyramid_level);
+    if (circles && circles->configured()) {
+        StageTimer timer(stats, Stage::Detect);
+        // Blob centres get no subpixel pass: a snapshot needs the full frame,
+        // tracking is fine on a smaller one.
+        return circles->detect(image, found, refinement == Refinement::Full ? 0 : pyramid_level + 1);
+    }
+    bool pattern_found;
+    {
+        StageTimer timer(stats, Stage::Detect);
+        cv::Mat level = image;
+        for (int i = 0; i < pyramid_level; ++i)
+            pyrDown(level, level);
+        pattern_found = findChessboardCorners(level, board_size, found, config.flags);
+        // Back to full resolution; cornerSubPix recovers the precision.
+        float scale = static_cast<float>(1 << pyramid_level);
+        for (cv::Point2f& corner : found)
+            corner *= scale;
+    }
+    if (pattern_found && refinement != Refinement::None) {
+        StageTimer timer(stats, Stage::Refine);
+        CornerRefiner::Options options;
+        options.max_window = config.subpix_window;
+        options.max_iterations = refinement == Refinement::Full ? config.subpix_iterations : 5;
+        options.epsilon = refinement == Refinement::Full ? config.subpix_epsilon : 0.1;
+        CornerRefiner(options).refine(image, board_size, found);
+    }
+    return pattern_found;
+}
+
+void CameraCalibration::collect_tuning_frame(const cv::Mat& image) {
+    std::lock_guard<std::mutex> lock(detection_mutex);
+    // Every few frames, so the set covers some movement rather than one pose.
+    if (tuning_frames.size() < tuning_target && frame_index % 5 == 0)
+        tuning_frames.push_back(image.clone());
+}
+
+void CameraCalibration::collect_tuning_frames(size_t count) {
+    std::lock_guard<std::mutex> lock(detection_mutex);
+    tuning_frames.clear();
+    tuning_target = count;
+}
+
+size_t CameraCalibration::tuning_frames_collected() const {
+    std::lock_guard<std::mutex> lock(detection_mutex);
+    return tuning_frames.size();
+}
+
+DetectionTuning CameraCalibration::tune_detection() {
+    std::vector<cv::Mat> frames;
+    {
+        std::lock_guard<std::mutex> lock(detection_mutex);
+        frames.swap(tuning_frames);
+        tuning_target = 0;
+    }
+    // The tuner benchmarks chessboard detection only.
+    if (target != TargetPattern::Chessboard)
+        frames.clear();
+    DetectionTuning tuning = ::tune_detection(frames, board_size);
+    if (!frames.empty())
+        set_detection_config(tuning.best);
+    return tuning;
+}
+
+void CameraCalibration::set_detection_config(const DetectionConfig& config) {
+    std::lock_guard<std::mutex> lock(detection_mutex);
+    detection = config;
+}
+
+DetectionConfig CameraCalibration::detection_config() const {
+    std::lock_guard<std::mutex> lock(detection_mutex);
+    return detection;
 }
 
 int CameraCalibration::identify_chessboard(cv::Mat& frame, const bool mode_take_snapshot) {
 
-    std::vector<cv::Point2f> corners;
-    corners.clear();
-    cv::Mat gray;
-    cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-
-    bool pattern_found = findChessboardCorners(gray, board_size, corners,
-                                               cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK);
-
-    if (pattern_found) {
-        cornerSubPix(gray, corners, cv::Size(11, 11),
-                     cv::Size(-1, -1),
-                     cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
-        if (mode_take_snapshot)
-        {
-            if (image_points.size() < 20) {
-                image_points.push_back(corners);
-            }
+    std::lock_guard<std::mutex> frame_lock(frame_mutex);
+    FrameArena::Scope arena_scope(arena);
+    TraceRecorder::set_frame(frame_index++);
+    auto frame_start = std::chrono::steady_clock::now();
+    snapshot_requested = snapshot_requested || mode_take_snapshot;
+    const DetectionQuality& quality = detection_levels[detect_scheduler.level()];
+    // The overlay alone does not need subpixel corners; pose tracking needs some.
+    // Snapshots keep a crop for full refinement at solve time, so live they
+    // only need the cheap setting, unless the crop budget is used up.
+    bool keep_crop = snapshot_requested && crop_bytes < max_crop_bytes && target == TargetPattern::Chessboard;
+    Refinement refinement = keep_crop ? Refinement::Fast
+                          : snapshot_requested ? Refinement::Full
+                          : pose_requested ? Refinement::Fast : Refinement::None;
+
+    // With parallel detection the overlay shows the newest in-order result,
+    // which may be a frame or two old; a snapshot waits for a fresh one
+    // detected with snapshot settings. Frames the scheduler skips keep
+    // showing the last corners.
+    bool fresh = true;
+    bool snapshot_frame = snapshot_requested;
+    BoardCrop crop;
+    cv::Mat snapshot_image = frame;
+    // Work done off the camera thread that still counts against the budget.
+    std::chrono::steady_clock::duration worker_cost(0);
+    if (!snapshot_requested && frame_index % quality.detect_interval != 0) {
+        fresh = false;
+    } else if (detector) {
+        detector->submit([&](cv::Mat& worker_gray) {
+            convert_gray(frame, worker_gray);
+            collect_tuning_frame(worker_gray);
+        }, refinement, keep_crop ? snapshot_crop_margin : 0, snapshot_requested ? frame : cv::Mat());
+        ParallelDetector::Result result;
+        fresh = detector->poll(result);
+        if (fresh) {
+            corners_found = result.found;
+            corners.swap(result.corners);
+            crop = std::move(result.crop);
+            snapshot_frame = result.crop_margin > 0 || result.refinement == Refinement::Full;
+            if (snapshot_frame)
+                snapshot_image = result.frame;
+            // The workers overlap, so each frame costs its share of a detection.
+            worker_cost = result.detect_time / detector->workers();
+        }
+    } else {
+        corners.clear();
+        convert_gray(frame, gray);
+        collect_tuning_frame(gray);
+        corners_found = detect_corners(gray, corners, quality.pyramid_level, refinement);
+        stats.detection(corners_found);
+        if (keep_crop && corners_found)
+            crop = crop_board(gray, corners, snapshot_crop_margin);
+    }
+    corners_fresh = fresh;
+
+    if (fresh && snapshot_requested && snapshot_frame) {
+        snapshot_requested = false;
+        if (corners_found && image_points.size() < max_views) {
+            image_points.push_back(corners);
+            snapshot_times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    frame_start.time_since_epoch()).count());
+            snapshot_quality.push_back(board_coverage(corners, board_size, image_size));
+            // Before the corners are drawn onto the frame.
+            snapshot_writer.submit(snapshot_image, static_cast<int>(image_points.size()) - 1);
+            crop_bytes += crop.bytes();
+            snapshot_crops.push_back(std::move(crop));
+            TraceRecorder::instance().counter("image_points", image_points.size());
         }
     }
-    drawChessboardCorners(frame, board_size, cv::Mat(corners), pattern_found);
+    {
+        StageTimer timer(stats, Stage::Draw);
+        drawChessboardCorners(frame, board_size, cv::Mat(corners), corners_found);
+    }
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - frame_start;
+    stats.frame_processed(elapsed);
+    detect_scheduler.frame_done(elapsed + worker_cost);
 
     return image_points.size();
 }
 
 void CameraCalibration::calc_board_corner_positions(std::vector<cv::Point3f>& obj) {
-    obj.clear();
-    for (int i = 0; i < board_size.height; ++i)
-        for (int j = 0; j < board_size.width; ++j)
-            obj.emplace_back(j * square_size, i * square_size, 0);
+    obj = target_object_points(target, board_size, static_cast<float>(square_size));
 }
 
-std::vector<cv::Mat> CameraCalibration::calibrate() {
+std::vector<std::vector<cv::Point3f> > CameraCalibration::object_points_for_views(size_t count) {
     float grid_width = (float)square_size * (board_size.width - 1.f);
 
     std::vector<std::vector<cv::Point3f> > object_points(1);
     calc_board_corner_positions(object_points[0]);
-    object_points[0][board_size.width - 1].x = object_points[0][0].x + grid_width;
-    object_points.resize(image_points.size(), object_points[0]);
+    if (target == TargetPattern::Chessboard)
+        object_points[0][board_size.width - 1].x = object_points[0][0].x + grid_width;
+    object_points.resize(count, object_points[0]);
+    return object_points;
+}
+
+void CameraCalibration::refine_snapshots() {
+    StageTimer timer(stats, Stage::Refine);
+    CornerRefiner::Options options;
+    options.window_fraction = 0.4;
+    options.max_window = snapshot_crop_margin / 2;
+    options.max_iterations = 100;
+    options.epsilon = 1e-3;
+    CornerRefiner refiner(options);
+
+    ThreadPool::shared()->parallel_for_(Lane::Latency, cv::Range(0, static_cast<int>(snapshot_crops.size())),
+                                        [&](const cv::Range& views) {
+        for (int i = views.start; i < views.end; ++i) {
+            BoardCrop& crop = snapshot_crops[i];
+            if (crop.gray.empty())
+                continue;
+            std::vector<cv::Point2f>& view = image_points[i];
+            cv::Point2f offset(static_cast<float>(crop.offset.x), static_cast<float>(crop.offset.y));
+            for (cv::Point2f& corner : view)
+                corner -= offset;
+            refiner.refine(crop.gray, board_size, view);
+            for (cv::Point2f& corner : view)
+                corner += offset;
+        }
+    });
+    // Refined once; the crops are not needed any more.
+    for (BoardCrop& crop : snapshot_crops)
+        crop = BoardCrop();
+    crop_bytes = 0;
+}
+
+std::vector<cv::Mat> CameraCalibration::calibrate() {
+    refine_snapshots();
+    std::vector<std::vector<cv::Point3f> > object_points = object_points_for_views(image_points.size());
 
     cv::Mat camera_matrix = cv::Mat::eye(3, 3, CV_64F);
     cv::Mat dist_coeffs = cv::Mat::zeros(8, 1, CV_64F);
 
     std::vector<cv::Mat> r_vecs, t_vecs;
-    calibrateCamera(object_points, image_points, image_size,
-                    camera_matrix, dist_coeffs, r_vecs, t_vecs);
+    {
+        StageTimer timer(stats, Stage::Solve);
+        if (lens_model == LensModel::Fisheye) {
+            calibrate_fisheye(object_points, image_points, image_size, camera_matrix, dist_coeffs, 0, 100);
+            distortion_model = "fisheye";
+        } else if (solver == CalibrationSolver::Sparse) {
+            SparseCalibrationResult sparse = SparseCalibrationSolver().solve(object_points[0], image_points, image_size);
+            camera_matrix = sparse.camera_matrix;
+            dist_coeffs = sparse.dist_coeffs;
+            distortion_model = "radial3_tangential";
+        } else if (solver == CalibrationSolver::ModelSelection) {
+            DistortionModelSelection selection = select_distortion_model(object_points[0], image_points, image_size);
+            camera_matrix = selection.camera_matrix;
+            dist_coeffs = selection.dist_coeffs;
+            distortion_model = selection.best().model.name;
+        } else {
+            calibrateCamera(object_points, image_points, image_size,
+                            camera_matrix, dist_coeffs, r_vecs, t_vecs);
+            distortion_model = "radial3_tangential";
+        }
+    }
 
     std::vector<cv::Mat> results {camera_matrix, dist_coeffs};
     return results;
 }
 
+CalibrationDataset CameraCalibration::dataset() {
+    refine_snapshots();
+    CalibrationDataset dataset;
+    dataset.board_size = board_size;
+    dataset.square_size = square_size;
+    dataset.pattern = target;
+    dataset.image_size = image_size;
+    dataset.views.resize(image_points.size());
+    for (size_t i = 0; i < image_points.size(); ++i) {
+        dataset.views[i].timestamp_ns = snapshot_times[i];
+        dataset.views[i].quality = snapshot_quality[i];
+        dataset.views[i].corners = image_points[i];
+    }
+    return dataset;
+}
+
+void CameraCalibration::load_dataset(const CalibrationDataset& dataset) {
+    target = dataset.pattern;
+    set_sizes(dataset.board_size, dataset.image_size, dataset.square_size);
+    image_points = dataset.image_points();
+    snapshot_times.clear();
+    snapshot_quality.clear();
+    for (const DatasetView& view : dataset.views) {
+        snapshot_times.push_back(view.timestamp_ns);
+        snapshot_quality.push_back(view.quality);
+    }
+    snapshot_crops.assign(image_points.size(), BoardCrop());
+    crop_bytes = 0;
+}
+
+const std::string& CameraCalibration::selected_distortion_model() const {
+    return distortion_model;
+}
+
+SolveReport CameraCalibration::calibrate_fast() {
+    refine_snapshots();
+    std::vector<std::vector<cv::Point3f> > object_points = object_points_for_views(image_points.size());
+    SolveReport preview;
+    preview.camera_matrix = cv::Mat::eye(3, 3, CV_64F);
+    preview.dist_coeffs = cv::Mat::zeros(8, 1, CV_64F);
+
+    StageTimer timer(stats, Stage::Solve);
+    auto start = std::chrono::steady_clock::now();
+    try {
+        if (lens_model == LensModel::Fisheye) {
+            preview.rms = calibrate_fisheye(object_points, image_points, image_size,
+                                            preview.camera_matrix, preview.dist_coeffs, 0, 20);
+            distortion_model = "fisheye";
+        } else {
+            preview.rms = calibrateCamera(object_points, image_points, image_size,
+                                          preview.camera_matrix, preview.dist_coeffs, cv::noArray(), cv::noArray(),
+                                          cv::CALIB_USE_LU,
+                                          cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 1e-6));
+            distortion_model = "radial3_tangential";
+        }
+    } catch (const cv::Exception&) {
+        preview.rms = std::numeric_limits<double>::quiet_NaN();
+    }
+    preview.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return preview;
+}
+
+void CameraCalibration::refine_in_background(const SolveReport& preview) {
+    // The task gets its own copy of the views: snapshots may keep arriving.
+    std::vector<std::vector<cv::Point2f> > views = image_points;
+    std::vector<std::vector<cv::Point3f> > object_points = object_points_for_views(views.size());
+    cv::Size size = image_size;
+    LensModel lens = lens_model;
+    SolveReport start_from = {preview.camera_matrix.clone(), preview.dist_coeffs.clone(), preview.rms, 0.0};
+    PipelineStats* solve_stats = &stats;
+
+    refinement = ThreadPool::shared()->submit(Lane::Background, [=]() mutable {
+        StageTimer timer(*solve_stats, Stage::Solve);
+        auto start = std::chrono::steady_clock::now();
+        SolveReport refined = start_from;
+        // Caught here: get() would rethrow it on the caller polling for the result.
+        try {
+            if (lens == LensModel::Fisheye)
+                refined.rms = calibrate_fisheye(object_points, views, size, refined.camera_matrix,
+                                                refined.dist_coeffs, cv::fisheye::CALIB_USE_INTRINSIC_GUESS, 100);
+            else
+                refined.rms = calibrateCamera(object_points, views, size, refined.camera_matrix, refined.dist_coeffs,
+                                              cv::noArray(), cv::noArray(), cv::CALIB_USE_INTRINSIC_GUESS);
+        } catch (const cv::Exception&) {
+            refined.rms = std::numeric_limits<double>::quiet_NaN();
+        }
+        refined.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return refined;
+    }).share();
+}
+
+bool CameraCalibration::refinement_ready() const {
+    return refinement.valid() &&
+           refinement.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+SolveReport CameraCalibration::refined_result() const {
+    return refinement.get();
+}
+
+std::vector<double> CameraCalibration::view_errors(const cv::Mat& matrix, const cv::Mat& dist) {
+    std::vector<cv::Point3f> board = object_points_for_views(1)[0];
+    std::vector<double> errors(image_points.size());
+    bool fisheye = lens_model == LensModel::Fisheye;
+    cv::Mat identity = cv::Mat::eye(3, 3, CV_64F);
+    ThreadPool::shared()->parallel_for_(Lane::Background, cv::Range(0, static_cast<int>(image_points.size())),
+                                        [&](const cv::Range& views) {
+        std::vector<cv::Point2f> projected, normalized;
+        for (int i = views.start; i < views.end; ++i) {
+            const std::vector<cv::Point2f>& view = image_points[i];
+            cv::Vec3d r_vec, t_vec;
+            if (fisheye) {
+                // solvePnP has no fisheye model; pose the board on undistorted, normalised corners.
+                cv::fisheye::undistortPoints(view, normalized, matrix, dist);
+                cv::solvePnP(board, normalized, identity, cv::noArray(), r_vec, t_vec, false, cv::SOLVEPNP_IPPE);
+                cv::solvePnPRefineLM(board, normalized, identity, cv::noArray(), r_vec, t_vec);
+                cv::fisheye::projectPoints(board, projected, r_vec, t_vec, matrix, dist);
+            } else {
+                cv::solvePnP(board, view, matrix, dist, r_vec, t_vec, false, cv::SOLVEPNP_IPPE);
+                cv::solvePnPRefineLM(board, view, matrix, dist, r_vec, t_vec);
+                cv::projectPoints(board, r_vec, t_vec, matrix, dist, projected);
+            }
+            errors[i] = cv::norm(view, projected, cv::NORM_L2) / std::sqrt(static_cast<double>(view.size()));
+        }
+    });
+    return errors;
+}
+
+BootstrapResult CameraCalibration::bootstrap(const cv::Mat& matrix, const cv::Mat& dist, int samples) {
+    std::vector<std::vector<cv::Point3f> > object_points = object_points_for_views(1);
+    StageTimer timer(stats, Stage::Solve);
+    return bootstrap_calibration(object_points[0], image_points, matrix, dist, samples);
+}
+
 void CameraCalibration::undistort_image(cv::Mat& frame, const cv::Mat& matrix, const cv::Mat& dist) {
-    cv::Mat temp = frame.clone();
-    undistort(temp, frame, matrix, dist);
+    FrameArena::Scope arena_scope(arena);
+    TraceRecorder::set_frame(frame_index++);
+    auto frame_start = std::chrono::steady_clock::now();
+    {
+        StageTimer timer(stats, Stage::Remap);
+        if (maps_outdated(matrix, dist, frame.size())) {
+            matrix.copyTo(map_matrix);
+            dist.copyTo(map_dist);
+            map_size = frame.size();
+            map_lens = lens_model;
+            map_balance = fisheye_balance;
+            map_fov_scale = fisheye_fov_scale;
+            if (lens_model == LensModel::Fisheye) {
+                cv::Mat new_matrix;
+                cv::fisheye::estimateNewCameraMatrixForUndistortRectify(matrix, dist, map_size, cv::Matx33d::eye(),
+                                                                        new_matrix, map_balance, map_size, map_fov_scale);
+                cv::fisheye::initUndistortRectifyMap(matrix, dist, cv::Matx33d::eye(), new_matrix, map_size, CV_16SC2,
+                                                     map1, map2);
+            } else {
+                initUndistortRectifyMap(matrix, dist, cv::Mat(), matrix, map_size, CV_16SC2, map1, map2);
+            }
+        }
+        frame.copyTo(undistort_source);
+        int interpolation = remap_interpolation[remap_scheduler.level()];
+        ThreadPool::shared()->parallel_for_(Lane::Latency, cv::Range(0, frame.rows), [&](const cv::Range& rows) {
+            cv::Mat frame_rows = frame.rowRange(rows);
+            remap(undistort_source, frame_rows, map1.rowRange(rows), map2.rowRange(rows), interpolation);
+        });
+    }
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - frame_start;
+    stats.frame_processed(elapsed);
+    remap_scheduler.frame_done(elapsed);
+}
+
+PipelineStats::Snapshot CameraCalibration::stats_snapshot() const {
+    FrameArena::Stats allocations = arena.stats();
+    PipelineStats::Snapshot snapshot = stats.snapshot(allocations.heap_bytes, allocations.bytes_in_use);
+    snapshot.detection_level = detect_scheduler.level();
+    snapshot.remap_level = remap_scheduler.level();
+    snapshot.quality_changes = detect_scheduler.changes() + remap_scheduler.changes();
+    return snapshot;
+}
+
+void CameraCalibration::reset_stats() {
+    stats.reset();
+    arena.reset_stats();
+}
+
+FrameArena::Stats CameraCalibration::allocation_stats() const {
+    return arena.stats();
+}
+
+void CameraCalibration::undistort_points(const std::vector<cv::Point2f>& points, std::vector<cv::Point2f>& undistorted,
+                                         const cv::Mat& matrix, const cv::Mat& dist) {
+    point_undistortion.update(matrix, dist, image_size);
+    undistorted.resize(points.size());
+    point_undistortion.undistort(points.data(), undistorted.data(), points.size());
+}
+
+void CameraCalibration::distort_points(const std::vector<cv::Point2f>& points, std::vector<cv::Point2f>& distorted,
+                                       const cv::Mat& matrix, const cv::Mat& dist) {
+    point_undistortion.update(matrix, dist, image_size);
+    distorted.resize(points.size());
+    point_undistortion.distort(points.data(), distorted.data(), points.size());
+}
+
+float CameraCalibration::point_undistortion_error() const {
+    return point_undistortion.max_error();
+}
+
+const BoardPose& CameraCalibration::board_pose(const cv::Mat& matrix, const cv::Mat& dist) {
+    pose_requested = true;
+    // Without new corners the pose cannot have changed; tracking follows the detection rate.
+    if (!corners_fresh && corners_found)
+        return pose_tracker.last();
+    StageTimer timer(stats, Stage::Pose);
+    static const std::vector<cv::Point2f> no_corners;
+    return pose_tracker.track(corners_found ? corners : no_corners, matrix, dist);
+}
+
+FrameScheduler::Options CameraCalibration::detection_schedule() {
+    return scheduler_levels(sizeof(detection_levels) / sizeof(detection_levels[0]));
+}
+
+FrameScheduler::Options CameraCalibration::remap_schedule() {
+    return scheduler_levels(sizeof(remap_interpolation) / sizeof(remap_interpolation[0]));
+}
+
+bool CameraCalibration::maps_outdated(const cv::Mat& matrix, const cv::Mat& dist, const cv::Size& size) const {
+    if (map1.empty() || size != map_size)
+        return true;
+    if (lens_model != map_lens || (lens_model == LensModel::Fisheye
+                                   && (fisheye_balance != map_balance || fisheye_fov_scale != map_fov_scale)))
+        return true;
+    if (matrix.size() != map_matrix.size() || dist.size() != map_dist.size())
+        return true;
+    return cv::norm(matrix, map_matrix, cv::NORM_INF) != 0 || cv::norm(dist, map_dist, cv::NORM_INF) != 0;
 }
\ No newline at end of file
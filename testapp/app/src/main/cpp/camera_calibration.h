@@ -10,25 +10,220 @@
 #include <opencv2/videoio.hpp>
 #include <opencv2/highgui.hpp>
 
+#include "board_pose.h"
+#include "calibration_bootstrap.h"
+#include "calibration_dataset.h"
+#include "calibration_target.h"
+#include "detection_tuning.h"
+#include "distortion_model_selection.h"
+#include "frame_arena.h"
+#include "frame_scheduler.h"
+#include "parallel_detector.h"
+#include "pipeline_stats.h"
+#include "point_undistortion.h"
+#include "snapshot_writer.h"
+#include "sparse_calibration_solver.h"
+#include "thread_pool.h"
+
+// Dense hands the views to cv::calibrateCamera; Sparse uses the
+// Schur-complement solver, which scales linearly with the number of views;
+// ModelSelection fits several distortion models in parallel and keeps the
+// simplest adequate one.
+enum class CalibrationSolver {
+    Dense,
+    Sparse,
+    ModelSelection
+};
+
+// Fisheye switches calibration and undistortion to cv::fisheye's
+// equidistant model with four distortion coefficients, for wide-angle lenses
+// the pinhole model fits poorly. The solver choice only applies to Pinhole.
+enum class LensModel {
+    Pinhole,
+    Fisheye
+};
+
+struct SolveReport {
+    cv::Mat camera_matrix;
+    cv::Mat dist_coeffs;
+    double rms;         // NaN when the solve failed on degenerate views
+    double seconds;
+};
+
 class CameraCalibration {
 
 private:
+    // Declared first so it outlives every buffer below that allocates from it.
+    FrameArena arena;
+    PipelineStats stats;
     cv::Size board_size;
     cv::Size image_size;
     int square_size;
+    TargetPattern target;
+    // Replaced, never modified, so detection workers can keep using the one they took.
+    std::shared_ptr<const CircleGridDetector> circle_detector;
     std::vector<std::vector<cv::Point2f> > image_points;
+    // Per snapshot, until calibrate() has refined it; empty when over budget.
+    std::vector<BoardCrop> snapshot_crops;
+    size_t crop_bytes;
+    // Per snapshot, for datasets.
+    std::vector<int64_t> snapshot_times;
+    std::vector<float> snapshot_quality;
+    SnapshotWriter snapshot_writer;
+    int64_t frame_index;
+    CalibrationSolver solver;
+    size_t max_views;
+    LensModel lens_model;
+    double fisheye_balance;
+    double fisheye_fov_scale;
+    std::string distortion_model;
+    std::shared_future<SolveReport> refinement;
+
+    // Per-frame scratch buffers, reused across calls.
+    cv::Mat gray;
+    std::vector<cv::Point2f> corners;
+    cv::Mat undistort_source;
+
+    // Undistortion maps, rebuilt only when the intrinsics or frame size change.
+    cv::Mat map_matrix;
+    cv::Mat map_dist;
+    cv::Size map_size;
+    LensModel map_lens;
+    double map_balance;
+    double map_fov_scale;
+    cv::Mat map1;
+    cv::Mat map2;
+    PointUndistortion point_undistortion;
+    BoardPoseTracker pose_tracker;
+    bool corners_found;
+    bool corners_fresh;
+    bool snapshot_requested;
+    bool pose_requested;
+    FrameScheduler detect_scheduler;
+    FrameScheduler remap_scheduler;
+    // Held for a whole identify_chessboard call, so settings the frame path
+    // depends on are changed between frames, never during one.
+    std::mutex frame_mutex;
+    mutable std::mutex detection_mutex;
+    DetectionConfig detection;
+    std::vector<cv::Mat> tuning_frames;
+    size_t tuning_target;
+    std::unique_ptr<ParallelDetector> detector;
+
+    std::vector<std::vector<cv::Point3f> > object_points_for_views(size_t count);
+    void convert_gray(const cv::Mat& frame, cv::Mat& out);
+    void collect_tuning_frame(const cv::Mat& image);
+    void refine_snapshots();
+    void reset_detector(int workers);
+    void clear_views();
+    bool detect_corners(const cv::Mat& image, std::vector<cv::Point2f>& found, int pyramid_level,
+                        Refinement refinement);
+    bool maps_outdated(const cv::Mat& matrix, const cv::Mat& dist, const cv::Size& size) const;
+    static FrameScheduler::Options detection_schedule();
+    static FrameScheduler::Options remap_schedule();
 public:
     CameraCalibration():
             board_size(cv::Size()),
             image_size(cv::Size()),
             square_size(0),
-            image_points(std::vector<std::vector<cv::Point2f> >())
-            {};
+            target(TargetPattern::Chessboard),
+            image_points(std::vector<std::vector<cv::Point2f> >()),
+            crop_bytes(0),
+            frame_index(0),
+            solver(CalibrationSolver::Dense),
+            max_views(20),
+            lens_model(LensModel::Pinhole),
+            fisheye_balance(0.0),
+            fisheye_fov_scale(1.0),
+            map_lens(LensModel::Pinhole),
+            map_balance(0.0),
+            map_fov_scale(1.0),
+            corners_found(false),
+            corners_fresh(false),
+            snapshot_requested(false),
+            pose_requested(false),
+            detect_scheduler(detection_schedule()),
+            remap_scheduler(remap_schedule()),
+            detection(DetectionConfig::defaults()),
+            tuning_target(0)
+            {
+                gray.allocator = &arena;
+                undistort_source.allocator = &arena;
+                map1.allocator = &arena;
+                map2.allocator = &arena;
+            };
     void set_sizes(const cv::Size& board, const cv::Size& image, const int square);
+    // Circle grids are found with findCirclesGrid on a downscaled frame, one
+    // pyramid level below the chessboard level. Snapshots search the full
+    // frame, as their centres get no subpixel refinement; autotuning leaves
+    // circle grids alone.
+    // The board size counts circles and the square size is the centre spacing.
+    // A new target drops the views collected so far; the change waits for the
+    // frame in progress and the detections in flight.
+    void set_target(TargetPattern pattern);
+    TargetPattern target_pattern() const;
+    // More than one worker switches to frame-parallel detection. Waits for the
+    // frame in progress and the detections in flight.
+    void set_detection_workers(int workers);
+    // Per-frame work adapts to the budget: detection is skipped on some frames
+    // or run on a coarser pyramid level, the undistort remap drops to nearest
+    // neighbour, and restores once there is headroom again. Off by default.
+    // With parallel detection a frame is charged its share of the workers'
+    // detection time on top of the camera thread's own.
+    void set_frame_budget(std::chrono::microseconds budget);
+    void set_adaptive_quality(bool enabled);
+    // Autotuning: keep every 5th preview gray frame until `count` are collected,
+    // then benchmark detection settings on them and switch to the best ones.
+    void collect_tuning_frames(size_t count);
+    size_t tuning_frames_collected() const;
+    DetectionTuning tune_detection();
+    void set_detection_config(const DetectionConfig& config);
+    DetectionConfig detection_config() const;
+    // Saves the frame each accepted snapshot was detected in into `directory` in the
+    // background; an empty directory stops saving.
+    bool set_snapshot_output(const std::string& directory, const SnapshotWriter::Options& options);
+    SnapshotWriter::Stats snapshot_output_stats() const;
+    void set_solver(CalibrationSolver calibration_solver, size_t view_limit);
+    // For the session: calibrate(), calibrate_fast(), view_errors() and
+    // undistort_image() follow the lens model. For Fisheye, `balance` trades
+    // the undistorted view between only valid pixels (0) and the whole source
+    // image (1), and `fov_scale` above 1 zooms out further. Point mapping,
+    // board pose and bootstrap assume the pinhole model.
+    void set_lens_model(LensModel model, double balance = 0.0, double fov_scale = 1.0);
+    LensModel lens() const;
     int identify_chessboard(cv::Mat& frame, const bool mode_take_snapshot);
     void calc_board_corner_positions(std::vector<cv::Point3f>& obj);
     std::vector<cv::Mat> calibrate();
-    static void undistort_image(cv::Mat& frame, const cv::Mat& matrix, const cv::Mat& dist);
+    const std::string& selected_distortion_model() const;
+    // The snapshots so far, with any deferred refinement applied, and back:
+    // loading replaces the snapshots, the target and the board and image sizes.
+    CalibrationDataset dataset();
+    void load_dataset(const CalibrationDataset& dataset);
+    // Two-tier solve: an LU-based preview returned right away, then an
+    // SVD-based refinement warm-started from it on the background lane. A
+    // failed solve is reported, not thrown: the background one would
+    // otherwise surface in whichever later call picks up the result.
+    SolveReport calibrate_fast();
+    void refine_in_background(const SolveReport& preview);
+    bool refinement_ready() const;
+    SolveReport refined_result() const;
+    // RMS reprojection error of each stored view under the given intrinsics,
+    // with the board pose re-estimated per view.
+    std::vector<double> view_errors(const cv::Mat& matrix, const cv::Mat& dist);
+    // Confidence intervals for a solution from resampling the stored views.
+    BootstrapResult bootstrap(const cv::Mat& matrix, const cv::Mat& dist, int samples = 200);
+    void undistort_image(cv::Mat& frame, const cv::Mat& matrix, const cv::Mat& dist);
+    // Raw image <-> undistort_image coordinates for a batch of points.
+    void undistort_points(const std::vector<cv::Point2f>& points, std::vector<cv::Point2f>& undistorted,
+                          const cv::Mat& matrix, const cv::Mat& dist);
+    void distort_points(const std::vector<cv::Point2f>& points, std::vector<cv::Point2f>& distorted,
+                        const cv::Mat& matrix, const cv::Mat& dist);
+    float point_undistortion_error() const;
+    // Board pose in the frame last passed to identify_chessboard.
+    const BoardPose& board_pose(const cv::Mat& matrix, const cv::Mat& dist);
+    FrameArena::Stats allocation_stats() const;
+    PipelineStats::Snapshot stats_snapshot() const;
+    void reset_stats();
 };
 
 #endif //TESTAPP_CAMERA_CALIBRATION_H
\ No newline at end of file
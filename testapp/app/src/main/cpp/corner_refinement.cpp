@@ -0,0 +1,210 @@
+#include "corner_refinement.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace {
+
+// Lanes a window is padded to: the widest float vector (AVX-512) so every
+// SIMD width steps through it without a tail.
+const int window_padding = 16;
+
+// Per-pixel terms of a (2 * half + 1)^2 window in one flat, padded run:
+// cornerSubPix's Gaussian weights and the offsets from the window centre.
+// Padding has zero weight.
+struct Window {
+    int count;
+    std::vector<float> weight;
+    std::vector<float> px;
+    std::vector<float> py;
+};
+
+const Window& window_terms(int half) {
+    static thread_local std::vector<Window> windows;
+    if (windows.size() <= static_cast<size_t>(half))
+        windows.resize(half + 1);
+    Window& window = windows[half];
+    if (window.weight.empty()) {
+        int size = 2 * half + 1;
+        window.count = (size * size + window_padding - 1) / window_padding * window_padding;
+        window.weight.assign(window.count, 0.f);
+        window.px.assign(window.count, 0.f);
+        window.py.assign(window.count, 0.f);
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x) {
+                float dy = (y - half) / static_cast<float>(half), dx = (x - half) / static_cast<float>(half);
+                window.weight[y * size + x] = std::exp(-dx * dx - dy * dy);
+                window.px[y * size + x] = static_cast<float>(x - half);
+                window.py[y * size + x] = static_cast<float>(y - half);
+            }
+    }
+    return window;
+}
+
+// The weighted structure tensor and its first moments over one window's
+// gradients: a, b, c, bx, by of the 2x2 saddle solve.
+void accumulate(const float* gx, const float* gy, const Window& window, double sums[5]) {
+    const float* weight = window.weight.data();
+    const float* px = window.px.data();
+    const float* py = window.py.data();
+#if CV_SIMD
+    cv::v_float32 a = cv::vx_setzero_f32(), b = a, c = a, bx = a, by = a;
+    for (int i = 0; i < window.count; i += cv::v_float32::nlanes) {
+        cv::v_float32 x = cv::vx_load(gx + i), y = cv::vx_load(gy + i), w = cv::vx_load(weight + i);
+        cv::v_float32 xx = x * x * w, xy = x * y * w, yy = y * y * w;
+        cv::v_float32 dx = cv::vx_load(px + i), dy = cv::vx_load(py + i);
+        a += xx;
+        b += xy;
+        c += yy;
+        bx = cv::v_muladd(xx, dx, cv::v_muladd(xy, dy, bx));
+        by = cv::v_muladd(xy, dx, cv::v_muladd(yy, dy, by));
+    }
+    sums[0] = cv::v_reduce_sum(a);
+    sums[1] = cv::v_reduce_sum(b);
+    sums[2] = cv::v_reduce_sum(c);
+    sums[3] = cv::v_reduce_sum(bx);
+    sums[4] = cv::v_reduce_sum(by);
+#else
+    float a = 0, b = 0, c = 0, bx = 0, by = 0;
+    for (int i = 0; i < window.count; ++i) {
+        float xx = gx[i] * gx[i] * weight[i], xy = gx[i] * gy[i] * weight[i], yy = gy[i] * gy[i] * weight[i];
+        a += xx;
+        b += xy;
+        c += yy;
+        bx += xx * px[i] + xy * py[i];
+        by += xy * px[i] + yy * py[i];
+    }
+    sums[0] = a;
+    sums[1] = b;
+    sums[2] = c;
+    sums[3] = bx;
+    sums[4] = by;
+#endif
+}
+
+float local_square(const std::vector<cv::Point2f>& corners, const cv::Size& board_size, int index) {
+    int x = index % board_size.width, y = index / board_size.width;
+    float nearest = std::numeric_limits<float>::max();
+    const int offsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    for (const int* offset : offsets) {
+        int nx = x + offset[0], ny = y + offset[1];
+        if (nx < 0 || ny < 0 || nx >= board_size.width || ny >= board_size.height)
+            continue;
+        nearest = std::min(nearest, static_cast<float>(cv::norm(corners[ny * board_size.width + nx] - corners[index])));
+    }
+    return nearest;
+}
+
+}
+
+CornerRefiner::CornerRefiner(const Options& options):
+        options(options) {
+}
+
+CornerRefiner::Report CornerRefiner::refine(const cv::Mat& gray, const cv::Size& board_size,
+                                            std::vector<cv::Point2f>& corners) const {
+    CV_Assert(gray.type() == CV_8UC1);
+    Report report = {0, 0};
+    bool grid = static_cast<int>(corners.size()) == board_size.area();
+    double epsilon_squared = options.epsilon * options.epsilon;
+
+    std::vector<int> halves(corners.size());
+    std::vector<cv::Point2f> points(corners);
+    std::vector<int> active;
+    active.reserve(corners.size());
+    for (size_t index = 0; index < corners.size(); ++index) {
+        float square = grid ? local_square(corners, board_size, static_cast<int>(index)) : 0.f;
+        int half = square > 0 && square < std::numeric_limits<float>::max()
+                   ? static_cast<int>(std::lround(square * options.window_fraction)) : options.max_window;
+        halves[index] = std::max(options.min_window, std::min(options.max_window, half));
+        if (options.max_iterations > 0)
+            active.push_back(static_cast<int>(index));
+    }
+
+    // One round per iteration over the corners still moving: their windows'
+    // gradients are gathered back to back into gx/gy, then each is reduced.
+    cv::Mat patch;
+    std::vector<float> gx, gy;
+    std::vector<int> offsets;
+    for (int iteration = 1; !active.empty(); ++iteration) {
+        offsets.resize(active.size());
+        int total = 0;
+        for (size_t k = 0; k < active.size(); ++k) {
+            offsets[k] = total;
+            total += window_terms(halves[active[k]]).count;
+        }
+        gx.resize(total);
+        gy.resize(total);
+        for (size_t k = 0; k < active.size(); ++k) {
+            int half = halves[active[k]];
+            int size = 2 * half + 1;
+            // One pixel of border for the central differences.
+            cv::getRectSubPix(gray, cv::Size(size + 2, size + 2), points[active[k]], patch, CV_32F);
+            float* gx_out = &gx[offsets[k]];
+            float* gy_out = &gy[offsets[k]];
+            for (int y = 0; y < size; ++y) {
+                const float* above = patch.ptr<float>(y);
+                const float* row = patch.ptr<float>(y + 1);
+                const float* below = patch.ptr<float>(y + 2);
+                for (int x = 0; x < size; ++x) {
+                    gx_out[y * size + x] = row[x + 2] - row[x];
+                    gy_out[y * size + x] = below[x + 1] - above[x + 1];
+                }
+            }
+            // The padding has zero weight but must not hold NaNs.
+            std::fill(gx_out + size * size, gx_out + window_terms(half).count, 0.f);
+            std::fill(gy_out + size * size, gy_out + window_terms(half).count, 0.f);
+        }
+
+        size_t kept = 0;
+        for (size_t k = 0; k < active.size(); ++k) {
+            int index = active[k];
+            double sums[5];
+            accumulate(&gx[offsets[k]], &gy[offsets[k]], window_terms(halves[index]), sums);
+            double a = sums[0], b = sums[1], c = sums[2], bx = sums[3], by = sums[4];
+            double det = a * c - b * b;
+            bool done = iteration >= options.max_iterations;
+            if (std::fabs(det) <= DBL_EPSILON * DBL_EPSILON) {
+                done = true;
+            } else {
+                // Offset of the saddle from the window centre.
+                double dx = (c * bx - b * by) / det;
+                double dy = (a * by - b * bx) / det;
+                points[index].x += static_cast<float>(dx);
+                points[index].y += static_cast<float>(dy);
+                if (dx * dx + dy * dy <= epsilon_squared) {
+                    ++report.converged;
+                    done = true;
+                }
+            }
+            if (done)
+                report.iterations += iteration;
+            else
+                active[kept++] = index;
+        }
+        active.resize(kept);
+    }
+
+    // Like cornerSubPix, keep the detection when the solve walked out of the window.
+    for (size_t index = 0; index < corners.size(); ++index)
+        if (std::fabs(points[index].x - corners[index].x) <= halves[index]
+            && std::fabs(points[index].y - corners[index].y) <= halves[index])
+            corners[index] = points[index];
+    return report;
+}
+
+BoardCrop crop_board(const cv::Mat& gray, const std::vector<cv::Point2f>& corners, int margin) {
+    BoardCrop crop;
+    cv::Rect bounds = cv::boundingRect(corners);
+    bounds -= cv::Point(margin, margin);
+    bounds += cv::Size(2 * margin, 2 * margin);
+    bounds &= cv::Rect(0, 0, gray.cols, gray.rows);
+    crop.offset = bounds.tl();
+    crop.gray.allocator = cv::Mat::getStdAllocator();
+    gray(bounds).copyTo(crop.gray);
+    return crop;
+}
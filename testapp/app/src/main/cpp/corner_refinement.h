@@ -0,0 +1,69 @@
+#ifndef TESTAPP_CORNER_REFINEMENT_H
+#define TESTAPP_CORNER_REFINEMENT_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+// How much subpixel work a detection gets: none for overlay-only frames, a
+// few iterations while the pose is tracked, full precision for snapshots.
+enum class Refinement {
+    None,
+    Fast,
+    Full
+};
+
+// Subpixel refinement of a detected chessboard, the same gradient/saddle
+// solve as cv::cornerSubPix but with a window per corner sized from the
+// local square size (distance to the neighbouring corners in the grid), so
+// small far-away boards are not smeared by neighbouring corners and large
+// close ones get enough support. All corners iterate together in rounds:
+// each round gathers the gradients of the windows still moving back to back
+// and reduces each window's sums with OpenCV universal intrinsics. A corner
+// leaves the batch as soon as its own update is below epsilon.
+class CornerRefiner {
+
+public:
+    struct Options {
+        double window_fraction;     // half window as a fraction of the square size
+        int min_window;
+        int max_window;
+        int max_iterations;
+        double epsilon;
+
+        Options():
+                window_fraction(0.3),
+                min_window(2),
+                max_window(10),
+                max_iterations(30),
+                epsilon(0.01)
+                {};
+    };
+
+    struct Report {
+        int iterations;         // summed over corners
+        int converged;          // corners that met epsilon before max_iterations
+    };
+
+    explicit CornerRefiner(const Options& options = Options());
+
+    // `corners` in findChessboardCorners order for a `board_size` grid; gray is CV_8UC1.
+    Report refine(const cv::Mat& gray, const cv::Size& board_size, std::vector<cv::Point2f>& corners) const;
+
+private:
+    Options options;
+};
+
+// Gray pixels around a detected board, kept with a snapshot so its corners
+// can be refined again later with a larger window than live detection affords.
+struct BoardCrop {
+    cv::Mat gray;
+    cv::Point offset;   // of the crop in the frame
+
+    size_t bytes() const { return gray.total() * gray.elemSize(); }
+};
+
+// Bounding box of the corners plus `margin` pixels, clipped to the frame. The
+// crop is heap allocated, not taken from a frame arena, as it outlives the frame.
+BoardCrop crop_board(const cv::Mat& gray, const std::vector<cv::Point2f>& corners, int margin);
+
+#endif //TESTAPP_CORNER_REFINEMENT_H
@@ -0,0 +1,209 @@
+#include "detection_tuning.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "corner_refinement.h"
+
+namespace {
+
+const int flag_sets[] = {
+    cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK,
+    cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_FAST_CHECK,
+    cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK,
+    cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FILTER_QUADS + cv::CALIB_CB_FAST_CHECK,
+};
+const int pyramid_levels[] = {0, 1};
+// Half window as a fraction of the square size: large enough to see the
+// saddle, small enough not to reach the neighbouring corners.
+const double window_fractions[] = {0.15, 0.25, 0.4};
+const int iteration_counts[] = {5, 10, 30};
+
+const double hit_rate_tolerance = 0.02;
+const double corner_error_tolerance = 0.05;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool detect(const cv::Mat& gray, const cv::Size& board_size, int flags, int pyramid_level,
+            std::vector<cv::Point2f>& corners) {
+    cv::Mat level = gray;
+    for (int i = 0; i < pyramid_level; ++i)
+        cv::pyrDown(level, level);
+    bool found = cv::findChessboardCorners(level, board_size, corners, flags);
+    for (cv::Point2f& corner : corners)
+        corner *= static_cast<float>(1 << pyramid_level);
+    return found;
+}
+
+double median_square_px(const std::vector<std::vector<cv::Point2f> >& boards, const cv::Size& board_size) {
+    std::vector<double> spacing;
+    for (const std::vector<cv::Point2f>& corners : boards)
+        for (int y = 0; y < board_size.height; ++y)
+            for (int x = 0; x + 1 < board_size.width; ++x)
+                spacing.push_back(cv::norm(corners[y * board_size.width + x + 1] - corners[y * board_size.width + x]));
+    if (spacing.empty())
+        return 0;
+    std::nth_element(spacing.begin(), spacing.begin() + spacing.size() / 2, spacing.end());
+    return spacing[spacing.size() / 2];
+}
+
+}
+
+DetectionConfig DetectionConfig::defaults() {
+    DetectionConfig config;
+    config.flags = cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK;
+    config.pyramid_level = 0;
+    // cornerSubPix(..., cv::Size(11, 11), ...): a 23x23 window.
+    config.subpix_window = 11;
+    config.subpix_iterations = 30;
+    config.subpix_epsilon = 0.1;
+    return config;
+}
+
+bool DetectionConfig::save(const std::string& path, const std::string& device) const {
+    cv::FileStorage storage(path, cv::FileStorage::WRITE);
+    if (!storage.isOpened())
+        return false;
+    storage << "device" << device;
+    storage << "flags" << flags;
+    storage << "pyramid_level" << pyramid_level;
+    storage << "subpix_window" << subpix_window;
+    storage << "subpix_iterations" << subpix_iterations;
+    storage << "subpix_epsilon" << subpix_epsilon;
+    return true;
+}
+
+bool DetectionConfig::load(const std::string& path, const std::string& device, DetectionConfig& config) {
+    cv::FileStorage storage;
+    try {
+        if (!storage.open(path, cv::FileStorage::READ))
+            return false;
+    } catch (const cv::Exception&) {
+        return false;
+    }
+    if (static_cast<std::string>(storage["device"]) != device)
+        return false;
+    DetectionConfig loaded = defaults();
+    storage["flags"] >> loaded.flags;
+    storage["pyramid_level"] >> loaded.pyramid_level;
+    storage["subpix_window"] >> loaded.subpix_window;
+    storage["subpix_iterations"] >> loaded.subpix_iterations;
+    storage["subpix_epsilon"] >> loaded.subpix_epsilon;
+    if (loaded.pyramid_level < 0 || loaded.subpix_window < 1 || loaded.subpix_iterations < 1)
+        return false;
+    config = loaded;
+    return true;
+}
+
+DetectionTuning tune_detection(const std::vector<cv::Mat>& gray_frames, const cv::Size& board_size) {
+    DetectionTuning tuning;
+    tuning.best = DetectionConfig::defaults();
+    tuning.frames = static_cast<int>(gray_frames.size());
+    tuning.square_px = 0;
+    if (gray_frames.empty())
+        return tuning;
+
+    // Detection: every flag set on every pyramid level.
+    std::vector<cv::Point2f> corners;
+    std::vector<std::vector<cv::Point2f> > reference_boards;
+    std::vector<const cv::Mat*> found_frames;
+    double best_hit_rate = 0;
+    std::vector<DetectionCandidate> detections;
+    for (int flags : flag_sets) {
+        for (int pyramid_level : pyramid_levels) {
+            DetectionCandidate candidate;
+            candidate.config = DetectionConfig::defaults();
+            candidate.config.flags = flags;
+            candidate.config.pyramid_level = pyramid_level;
+            int found = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (const cv::Mat& gray : gray_frames) {
+                bool hit = detect(gray, board_size, flags, pyramid_level, corners);
+                found += hit;
+                // The default configuration's detections are the refinement reference.
+                if (hit && detections.empty()) {
+                    reference_boards.push_back(corners);
+                    found_frames.push_back(&gray);
+                }
+            }
+            candidate.detect_ms = elapsed_ms(start) / gray_frames.size();
+            candidate.hit_rate = static_cast<double>(found) / gray_frames.size();
+            candidate.refine_ms = 0;
+            candidate.corner_error = 0;
+            best_hit_rate = std::max(best_hit_rate, candidate.hit_rate);
+            detections.push_back(candidate);
+        }
+    }
+    const DetectionCandidate* chosen = &detections[0];
+    for (const DetectionCandidate& candidate : detections)
+        if (candidate.hit_rate >= best_hit_rate - hit_rate_tolerance &&
+            (chosen->hit_rate < best_hit_rate - hit_rate_tolerance || candidate.detect_ms < chosen->detect_ms))
+            chosen = &candidate;
+    tuning.best.flags = chosen->config.flags;
+    tuning.best.pyramid_level = chosen->config.pyramid_level;
+    tuning.candidates = detections;
+    if (reference_boards.empty())
+        return tuning;
+
+    // Refinement: windows scaled to the square size, against a converged reference.
+    tuning.square_px = median_square_px(reference_boards, board_size);
+    int reference_window = std::max(2, static_cast<int>(tuning.square_px * 0.4));
+    std::vector<std::vector<cv::Point2f> > references = reference_boards;
+    CornerRefiner::Options reference_options;
+    reference_options.max_window = reference_window;
+    reference_options.max_iterations = 100;
+    reference_options.epsilon = 1e-4;
+    for (size_t i = 0; i < references.size(); ++i)
+        CornerRefiner(reference_options).refine(*found_frames[i], board_size, references[i]);
+
+    const DetectionCandidate* best_refinement = nullptr;
+    size_t first_refinement = tuning.candidates.size();
+    // The untuned window competes too, so tuning never ends up below it on accuracy.
+    std::vector<int> windows {DetectionConfig::defaults().subpix_window};
+    for (double fraction : window_fractions)
+        windows.push_back(std::max(2, static_cast<int>(tuning.square_px * fraction)));
+    for (int window : windows) {
+        for (int iterations : iteration_counts) {
+            DetectionCandidate candidate;
+            candidate.config = tuning.best;
+            candidate.config.subpix_window = window;
+            candidate.config.subpix_iterations = iterations;
+            candidate.config.subpix_epsilon = 0.01;
+            candidate.detect_ms = chosen->detect_ms;
+            candidate.hit_rate = chosen->hit_rate;
+            CornerRefiner::Options refiner_options;
+            refiner_options.max_window = window;
+            refiner_options.max_iterations = iterations;
+            refiner_options.epsilon = candidate.config.subpix_epsilon;
+            CornerRefiner refiner(refiner_options);
+            double error = 0, refine_ms = 0;
+            size_t points = 0;
+            for (size_t i = 0; i < reference_boards.size(); ++i) {
+                corners = reference_boards[i];
+                auto start = std::chrono::steady_clock::now();
+                refiner.refine(*found_frames[i], board_size, corners);
+                refine_ms += elapsed_ms(start);
+                for (size_t j = 0; j < corners.size(); ++j)
+                    error += cv::norm(corners[j] - references[i][j]);
+                points += corners.size();
+            }
+            candidate.refine_ms = refine_ms / reference_boards.size();
+            candidate.corner_error = error / points;
+            tuning.candidates.push_back(candidate);
+        }
+    }
+    for (size_t i = first_refinement; i < tuning.candidates.size(); ++i) {
+        const DetectionCandidate& candidate = tuning.candidates[i];
+        if (candidate.corner_error <= corner_error_tolerance &&
+            (!best_refinement || candidate.refine_ms < best_refinement->refine_ms))
+            best_refinement = &candidate;
+    }
+    if (best_refinement)
+        tuning.best = best_refinement->config;
+    return tuning;
+}
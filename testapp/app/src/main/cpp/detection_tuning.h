@@ -0,0 +1,49 @@
+#ifndef TESTAPP_DETECTION_TUNING_H
+#define TESTAPP_DETECTION_TUNING_H
+
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Chessboard detection and subpixel refinement parameters.
+struct DetectionConfig {
+    int flags;              // findChessboardCorners flags
+    int pyramid_level;      // detect on a 2^level times smaller image
+    int subpix_window;      // largest CornerRefiner half window
+    int subpix_iterations;
+    double subpix_epsilon;
+
+    // The values identify_chessboard used before tuning existed: the same
+    // flags and cornerSubPix's 11 px half window, 30 iterations, epsilon 0.1.
+    static DetectionConfig defaults();
+
+    // Persisted with cv::FileStorage, tagged with the device it was tuned on;
+    // load() rejects files from another device.
+    bool save(const std::string& path, const std::string& device) const;
+    static bool load(const std::string& path, const std::string& device, DetectionConfig& config);
+};
+
+struct DetectionCandidate {
+    DetectionConfig config;
+    double detect_ms;       // mean findChessboardCorners time per frame
+    double refine_ms;       // mean subpixel refinement time per found frame
+    double hit_rate;
+    double corner_error;    // mean distance to a converged large-window refinement, px
+};
+
+struct DetectionTuning {
+    std::vector<DetectionCandidate> candidates;
+    DetectionConfig best;
+    double square_px;       // median board square size in the frames
+    int frames;
+};
+
+// Benchmarks detection flag sets and pyramid levels for latency and hit rate,
+// then subpixel window sizes (scaled to the board's square size in pixels)
+// and iteration counts for latency and accuracy on the frames where the board
+// was found. The fastest detection within 2% of the best hit rate wins, then
+// the fastest refinement within 0.05 px of the reference. Candidates run one
+// at a time on the calling thread so their timings do not disturb each other.
+DetectionTuning tune_detection(const std::vector<cv::Mat>& gray_frames, const cv::Size& board_size);
+
+#endif //TESTAPP_DETECTION_TUNING_H
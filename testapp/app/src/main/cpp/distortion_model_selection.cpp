@@ -0,0 +1,123 @@
+#include "distortion_model_selection.h"
+
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <opencv2/calib3d.hpp>
+
+#include "thread_pool.h"
+
+namespace {
+
+double reprojection_rms(const std::vector<cv::Point3f>& board,
+                        const std::vector<std::vector<cv::Point2f> >& views,
+                        const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs) {
+    double squared = 0;
+    size_t points = 0;
+    std::vector<cv::Point2f> projected;
+    for (const std::vector<cv::Point2f>& view : views) {
+        cv::Vec3d r_vec, t_vec;
+        cv::solvePnP(board, view, camera_matrix, dist_coeffs, r_vec, t_vec, false, cv::SOLVEPNP_IPPE);
+        cv::solvePnPRefineLM(board, view, camera_matrix, dist_coeffs, r_vec, t_vec);
+        cv::projectPoints(board, r_vec, t_vec, camera_matrix, dist_coeffs, projected);
+        for (size_t i = 0; i < view.size(); ++i) {
+            cv::Point2f delta = projected[i] - view[i];
+            squared += delta.dot(delta);
+        }
+        points += view.size();
+    }
+    return points ? std::sqrt(squared / points) : 0.0;
+}
+
+DistortionModelFit fit_model(const DistortionModel& model, const std::vector<cv::Point3f>& board,
+                             const std::vector<std::vector<cv::Point2f> >& train,
+                             const std::vector<std::vector<cv::Point2f> >& holdout,
+                             const cv::Size& image_size) {
+    auto start = std::chrono::steady_clock::now();
+    DistortionModelFit fit;
+    fit.model = model;
+    fit.camera_matrix = cv::Mat::eye(3, 3, CV_64F);
+    cv::Mat dist = cv::Mat::zeros(14, 1, CV_64F);
+
+    std::vector<std::vector<cv::Point3f> > object_points(train.size(), board);
+    fit.train_rms = cv::calibrateCamera(object_points, train, image_size, fit.camera_matrix, dist,
+                                        cv::noArray(), cv::noArray(), model.flags);
+    fit.dist_coeffs = dist.rowRange(0, model.coefficients).clone();
+    fit.holdout_rms = holdout.empty() ? fit.train_rms
+            : reprojection_rms(board, holdout, fit.camera_matrix, fit.dist_coeffs);
+    fit.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return fit;
+}
+
+}
+
+const std::vector<DistortionModel>& candidate_distortion_models() {
+    static const std::vector<DistortionModel> models {
+        {"radial2_fixed_aspect", cv::CALIB_FIX_K3 | cv::CALIB_ZERO_TANGENT_DIST | cv::CALIB_FIX_ASPECT_RATIO, 4},
+        {"radial2", cv::CALIB_FIX_K3 | cv::CALIB_ZERO_TANGENT_DIST, 4},
+        {"radial2_tangential", cv::CALIB_FIX_K3, 4},
+        {"radial3_fixed_aspect", cv::CALIB_FIX_ASPECT_RATIO, 5},
+        {"radial3_tangential", 0, 5},
+        {"rational", cv::CALIB_RATIONAL_MODEL, 8},
+        {"thin_prism", cv::CALIB_RATIONAL_MODEL | cv::CALIB_THIN_PRISM_MODEL, 12},
+    };
+    return models;
+}
+
+DistortionModelSelection select_distortion_model(const std::vector<cv::Point3f>& board,
+                                                 const std::vector<std::vector<cv::Point2f> >& views,
+                                                 const cv::Size& image_size,
+                                                 double tolerance, int holdout_every) {
+    std::vector<std::vector<cv::Point2f> > train, holdout;
+    for (size_t i = 0; i < views.size(); ++i) {
+        bool held_out = holdout_every > 1 && views.size() >= 4 && static_cast<int>(i % holdout_every) == holdout_every - 1;
+        (held_out ? holdout : train).push_back(views[i]);
+    }
+
+    std::shared_ptr<ThreadPool> pool = ThreadPool::shared();
+    const std::vector<DistortionModel>& models = candidate_distortion_models();
+    std::vector<std::future<DistortionModelFit> > pending;
+    for (const DistortionModel& model : models)
+        pending.push_back(pool->submit(Lane::Background, [&, model] {
+            try {
+                return fit_model(model, board, train, holdout, image_size);
+            } catch (const cv::Exception&) {
+                // Too few views for the richer models; rule the candidate out.
+                DistortionModelFit failed;
+                failed.model = model;
+                failed.train_rms = failed.holdout_rms = std::numeric_limits<double>::infinity();
+                failed.seconds = 0;
+                return failed;
+            }
+        }));
+
+    // Wait for every fit before get() can throw: the tasks reference locals.
+    for (std::future<DistortionModelFit>& fit : pending)
+        fit.wait();
+    DistortionModelSelection selection;
+    for (std::future<DistortionModelFit>& fit : pending)
+        selection.fits.push_back(fit.get());
+
+    // A NaN compares false both ways and could be picked; only finite errors count.
+    double best = std::numeric_limits<double>::infinity();
+    for (const DistortionModelFit& fit : selection.fits)
+        if (std::isfinite(fit.holdout_rms))
+            best = std::min(best, fit.holdout_rms);
+    // Candidates are ordered by complexity, so the first adequate one is the simplest.
+    selection.selected = 0;
+    while (selection.selected + 1 < selection.fits.size()
+           && !(selection.fits[selection.selected].holdout_rms <= best * (1 + tolerance)))
+        ++selection.selected;
+
+    const DistortionModel& chosen = selection.best().model;
+    if (holdout.empty()) {
+        selection.camera_matrix = selection.best().camera_matrix;
+        selection.dist_coeffs = selection.best().dist_coeffs;
+    } else {
+        DistortionModelFit refit = fit_model(chosen, board, views, {}, image_size);
+        selection.camera_matrix = refit.camera_matrix;
+        selection.dist_coeffs = refit.dist_coeffs;
+    }
+    return selection;
+}
@@ -0,0 +1,47 @@
+#ifndef TESTAPP_DISTORTION_MODEL_SELECTION_H
+#define TESTAPP_DISTORTION_MODEL_SELECTION_H
+
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+struct DistortionModel {
+    const char* name;
+    int flags;          // cv::calibrateCamera flags
+    int coefficients;   // length of the returned distortion vector
+};
+
+// Candidates from simplest to most complex: radial-only with and without a
+// fixed aspect ratio, radial plus tangential, the default 5-coefficient
+// model, the rational 8-coefficient model and the thin-prism 12-coefficient one.
+const std::vector<DistortionModel>& candidate_distortion_models();
+
+struct DistortionModelFit {
+    DistortionModel model;
+    cv::Mat camera_matrix;
+    cv::Mat dist_coeffs;
+    double train_rms;
+    double holdout_rms;
+    double seconds;
+};
+
+struct DistortionModelSelection {
+    std::vector<DistortionModelFit> fits;
+    size_t selected;
+    cv::Mat camera_matrix;
+    cv::Mat dist_coeffs;
+
+    const DistortionModelFit& best() const { return fits[selected]; }
+};
+
+// Fits every candidate concurrently on the thread pool's background lane,
+// training on all views but every `holdout_every`-th and scoring on the held
+// out ones (pose re-estimated with the fitted intrinsics). The simplest model
+// whose held-out error is within `tolerance` of the best one wins and is
+// refitted on all views.
+DistortionModelSelection select_distortion_model(const std::vector<cv::Point3f>& board,
+                                                 const std::vector<std::vector<cv::Point2f> >& views,
+                                                 const cv::Size& image_size,
+                                                 double tolerance = 0.05, int holdout_every = 4);
+
+#endif //TESTAPP_DISTORTION_MODEL_SELECTION_H
@@ -0,0 +1,164 @@
+#include "frame_arena.h"
+
+#include <new>
+
+namespace {
+
+thread_local FrameArena* thread_arena = nullptr;
+
+// Installed once as the process default. Each request goes to the arena of
+// the calling thread's scope, or to the standard allocator outside scopes;
+// buffers are released through the allocator that made them.
+class ThreadArenaAllocator : public cv::MatAllocator {
+
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override {
+        const cv::MatAllocator* target = thread_arena ? thread_arena : cv::Mat::getStdAllocator();
+        return target->allocate(dims, sizes, type, data0, step, flags, usage_flags);
+    }
+    bool allocate(cv::UMatData* u, cv::AccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override {
+        return u && u->currAllocator != this && u->currAllocator->allocate(u, access_flags, usage_flags);
+    }
+    void deallocate(cv::UMatData* u) const override {
+        if (u && u->currAllocator != this)
+            u->currAllocator->deallocate(u);
+    }
+};
+
+void install_thread_arena_allocator() {
+    static ThreadArenaAllocator* allocator = [] {
+        ThreadArenaAllocator* installed = new ThreadArenaAllocator();
+        cv::Mat::setDefaultAllocator(installed);
+        return installed;
+    }();
+    (void) allocator;
+}
+
+}
+
+FrameArena::Scope::Scope(FrameArena& arena):
+        previous(thread_arena) {
+    install_thread_arena_allocator();
+    thread_arena = &arena;
+}
+
+FrameArena::Scope::~Scope() {
+    thread_arena = previous;
+}
+
+FrameArena::FrameArena(size_t max_pooled_bytes):
+        max_pooled_bytes(max_pooled_bytes),
+        counters(Stats()) {
+    free_blocks.reserve(64);
+    free_headers.reserve(64);
+}
+
+FrameArena::~FrameArena() {
+    trim();
+}
+
+cv::UMatData* FrameArena::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                                   cv::AccessFlag, cv::UMatUsageFlags) const {
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != cv::Mat::AUTO_STEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    cv::UMatData* u = acquire_header();
+    if (data0) {
+        u->data = u->origdata = static_cast<uchar*>(data0);
+        u->flags = cv::UMatData::USER_ALLOCATED;
+    } else {
+        u->data = u->origdata = acquire_block(total);
+        counters.bytes_in_use += total;
+    }
+    u->size = total;
+    return u;
+}
+
+bool FrameArena::allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const {
+    return u != nullptr;
+}
+
+void FrameArena::deallocate(cv::UMatData* u) const {
+    if (!u)
+        return;
+
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED) && u->origdata) {
+        counters.bytes_in_use -= u->size;
+        if (counters.bytes_pooled + u->size <= max_pooled_bytes) {
+            free_blocks.push_back(Block{u->origdata, u->size});
+            counters.bytes_pooled += u->size;
+        } else {
+            cv::fastFree(u->origdata);
+        }
+    }
+    u->~UMatData();
+    free_headers.push_back(u);
+}
+
+FrameArena::Stats FrameArena::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void FrameArena::reset_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.heap_allocations = 0;
+    counters.heap_bytes = 0;
+    counters.pool_hits = 0;
+}
+
+void FrameArena::trim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Block& block : free_blocks)
+        cv::fastFree(block.data);
+    for (cv::UMatData* u : free_headers)
+        ::operator delete(u);
+    free_blocks.clear();
+    free_headers.clear();
+    counters.bytes_pooled = 0;
+}
+
+cv::UMatData* FrameArena::acquire_header() const {
+    void* storage;
+    if (free_headers.empty()) {
+        storage = ::operator new(sizeof(cv::UMatData));
+        counters.heap_allocations++;
+        counters.heap_bytes += sizeof(cv::UMatData);
+    } else {
+        storage = free_headers.back();
+        free_headers.pop_back();
+    }
+    return new (storage) cv::UMatData(this);
+}
+
+uchar* FrameArena::acquire_block(size_t size) const {
+    for (size_t i = 0; i < free_blocks.size(); ++i) {
+        if (free_blocks[i].size == size) {
+            uchar* data = free_blocks[i].data;
+            free_blocks[i] = free_blocks.back();
+            free_blocks.pop_back();
+            counters.bytes_pooled -= size;
+            counters.pool_hits++;
+            return data;
+        }
+    }
+    counters.heap_allocations++;
+    counters.heap_bytes += size;
+    return static_cast<uchar*>(cv::fastMalloc(size));
+}
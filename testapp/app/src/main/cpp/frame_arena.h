@@ -0,0 +1,71 @@
+#ifndef TESTAPP_FRAME_ARENA_H
+#define TESTAPP_FRAME_ARENA_H
+
+#include <mutex>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// cv::MatAllocator that keeps released buffers on a free list and hands them
+// out again to the next request of the same size. With a steady stream of
+// equally sized frames the heap is only touched during warm-up.
+//
+// Every Mat allocated from the arena must be released before the arena is
+// destroyed, so owners declare it ahead of the buffers that use it.
+class FrameArena : public cv::MatAllocator {
+
+public:
+    struct Stats {
+        size_t heap_allocations;
+        size_t heap_bytes;
+        size_t pool_hits;
+        size_t bytes_in_use;
+        size_t bytes_pooled;
+    };
+
+    // Routes Mats the current thread creates without an explicit allocator
+    // (including the temporaries inside OpenCV calls) to the arena while in
+    // scope; the innermost scope wins. Other threads, and work OpenCV hands to
+    // its own workers, keep the standard allocator.
+    class Scope {
+    public:
+        explicit Scope(FrameArena& arena);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        FrameArena* previous;
+    };
+
+    explicit FrameArena(size_t max_pooled_bytes = 64u << 20u);
+    ~FrameArena() override;
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override;
+    bool allocate(cv::UMatData* u, cv::AccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override;
+    void deallocate(cv::UMatData* u) const override;
+
+    Stats stats() const;
+    void reset_stats();
+    void trim();
+
+private:
+    struct Block {
+        uchar* data;
+        size_t size;
+    };
+
+    cv::UMatData* acquire_header() const;
+    uchar* acquire_block(size_t size) const;
+
+    const size_t max_pooled_bytes;
+    mutable std::mutex mutex;
+    mutable std::vector<Block> free_blocks;
+    mutable std::vector<cv::UMatData*> free_headers;
+    mutable Stats counters;
+};
+
+#endif //TESTAPP_FRAME_ARENA_H
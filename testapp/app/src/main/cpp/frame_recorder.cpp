@@ -0,0 +1,315 @@
+#include "frame_recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+#include "trace_recorder.h"
+
+namespace {
+
+const uint32_t recording_version = 1;
+
+size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+int frame_rows(cv::Size size, FrameFormat format) {
+    return format == FrameFormat::NV21 ? size.height * 3 / 2 : size.height;
+}
+
+}
+
+FrameRecorder::FrameRecorder():
+        active(false),
+        producers(0),
+        staged_head(0),
+        staged_tail(0),
+        written(0),
+        dropped(0),
+        next_sequence(0),
+        fd(-1),
+        mapping(nullptr),
+        mapping_bytes(0),
+        header(nullptr),
+        index(nullptr),
+        format(FrameFormat::Y8),
+        stopping(false) {
+}
+
+FrameRecorder::~FrameRecorder() {
+    stop();
+}
+
+bool FrameRecorder::start(const std::string& path, cv::Size size, FrameFormat frame_format,
+                          const std::string& device, const Options& options) {
+    if (active.load() || writer.joinable() || size.area() <= 0 || options.slots <= 0 || options.staging <= 0)
+        return false;
+
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t frame_bytes = static_cast<size_t>(size.width) * frame_rows(size, frame_format);
+    size_t slot_bytes = align_up(frame_bytes, page);
+    size_t index_offset = align_up(sizeof(RecordingHeader), 64);
+    size_t data_offset = align_up(index_offset + options.slots * sizeof(RecordedFrameEntry), page);
+    size_t total = data_offset + options.slots * slot_bytes;
+
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    // Reserve the blocks up front so writes to the mapping cannot run out of
+    // space; filesystems without fallocate get a sparse file instead.
+    if (posix_fallocate(fd, 0, static_cast<off_t>(total)) != 0 && ftruncate(fd, static_cast<off_t>(total)) != 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    void* address = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    mapping = static_cast<uchar*>(address);
+    mapping_bytes = total;
+    header = reinterpret_cast<RecordingHeader*>(mapping);
+    index = reinterpret_cast<RecordedFrameEntry*>(mapping + index_offset);
+
+    std::memset(header, 0, sizeof(RecordingHeader));
+    std::memcpy(header->magic, "CALREC1", 8);
+    header->version = recording_version;
+    header->slot_count = static_cast<uint32_t>(options.slots);
+    header->slot_bytes = slot_bytes;
+    header->index_offset = index_offset;
+    header->data_offset = data_offset;
+    header->created_unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    strncpy(header->device, device.c_str(), sizeof(header->device) - 1);
+    std::memset(index, 0, options.slots * sizeof(RecordedFrameEntry));
+
+    staging.resize(options.staging);
+    for (Staged& staged : staging)
+        staged.data.reset(new uchar[frame_bytes]);
+    frame_size = size;
+    format = frame_format;
+    staged_head.store(0);
+    staged_tail.store(0);
+    written.store(0);
+    dropped.store(0);
+    next_sequence = 0;
+    stopping = false;
+    writer = std::thread(&FrameRecorder::writer_loop, this);
+    active.store(true, std::memory_order_release);
+    return true;
+}
+
+long FrameRecorder::stop() {
+    // seq_cst on both sides of the handshake with the producer's check below.
+    if (!active.exchange(false, std::memory_order_seq_cst))
+        return -1;
+    while (producers.load(std::memory_order_seq_cst) != 0)
+        std::this_thread::yield();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_one();
+    writer.join();
+
+    header->frames_dropped = dropped.load();
+    msync(mapping, mapping_bytes, MS_SYNC);
+    munmap(mapping, mapping_bytes);
+    close(fd);
+    fd = -1;
+    mapping = nullptr;
+    header = nullptr;
+    index = nullptr;
+    staging.clear();
+    return static_cast<long>(written.load());
+}
+
+bool FrameRecorder::record(const cv::Mat& frame, int64_t timestamp_ns, uint32_t flags) {
+    if (!enabled())
+        return false;
+    // Keeps stop() from unmapping while a frame is being staged. Registering
+    // and then checking `active`, against stop() clearing it and then checking
+    // the producers, is a store-load handshake: seq_cst, or both can miss.
+    producers.fetch_add(1, std::memory_order_seq_cst);
+    bool staged = false;
+    if (active.load(std::memory_order_seq_cst)) {
+        uint64_t head = staged_head.load(std::memory_order_relaxed);
+        bool fits = frame.type() == CV_8UC1 && frame.cols == frame_size.width
+                && frame.rows == frame_rows(frame_size, format);
+        if (fits && head - staged_tail.load(std::memory_order_acquire) < staging.size()) {
+            Staged& slot = staging[head % staging.size()];
+            size_t row_bytes = static_cast<size_t>(frame.cols);
+            if (frame.isContinuous()) {
+                std::memcpy(slot.data.get(), frame.data, row_bytes * frame.rows);
+            } else {
+                for (int row = 0; row < frame.rows; ++row)
+                    std::memcpy(slot.data.get() + row * row_bytes, frame.ptr(row), row_bytes);
+            }
+            RecordedFrameEntry& entry = slot.entry;
+            entry.sequence = ++next_sequence;
+            entry.timestamp_ns = timestamp_ns;
+            entry.width = static_cast<uint32_t>(frame_size.width);
+            entry.height = static_cast<uint32_t>(frame_size.height);
+            entry.format = static_cast<uint32_t>(format);
+            entry.flags = flags;
+            entry.bytes = row_bytes * frame.rows;
+            staged_head.store(head + 1, std::memory_order_release);
+            staged = true;
+            TraceRecorder::instance().counter("recorder_staging",
+                    head + 1 - staged_tail.load(std::memory_order_relaxed));
+        }
+    }
+    producers.fetch_sub(1, std::memory_order_release);
+
+    if (!staged) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Not under the mutex, so a wake-up can be missed; the writer also polls.
+    ready.notify_one();
+    return true;
+}
+
+uint64_t FrameRecorder::frames_written() const {
+    return written.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameRecorder::frames_dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void FrameRecorder::writer_loop() {
+    ThreadPool::shared()->pin_current_thread(Lane::Background);
+    for (;;) {
+        bool finish;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait_for(lock, std::chrono::milliseconds(10), [this] {
+                return stopping || staged_tail.load() != staged_head.load();
+            });
+            finish = stopping;
+        }
+        uint64_t tail = staged_tail.load(std::memory_order_relaxed);
+        while (tail != staged_head.load(std::memory_order_acquire)) {
+            write(staging[tail % staging.size()]);
+            staged_tail.store(++tail, std::memory_order_release);
+            TraceRecorder::instance().counter("recorder_staging", staged_head.load(std::memory_order_relaxed) - tail);
+        }
+        if (finish)
+            return;
+    }
+}
+
+void FrameRecorder::write(const Staged& staged) {
+    const RecordedFrameEntry& source = staged.entry;
+    size_t slot = static_cast<size_t>((source.sequence - 1) % header->slot_count);
+    RecordedFrameEntry& entry = index[slot];
+
+    // Invalidate the slot first and publish the sequence last, so a recording
+    // cut short never pairs an entry with half of another frame.
+    __atomic_store_n(&entry.sequence, 0, __ATOMIC_RELEASE);
+    std::memcpy(mapping + header->data_offset + slot * header->slot_bytes, staged.data.get(), source.bytes);
+    entry.timestamp_ns = source.timestamp_ns;
+    entry.width = source.width;
+    entry.height = source.height;
+    entry.format = source.format;
+    entry.flags = source.flags;
+    entry.bytes = source.bytes;
+    __atomic_store_n(&entry.sequence, source.sequence, __ATOMIC_RELEASE);
+
+    header->frames_written = source.sequence;
+    header->frames_dropped = dropped.load(std::memory_order_relaxed);
+    written.store(source.sequence, std::memory_order_relaxed);
+}
+
+FrameRecording::FrameRecording():
+        fd(-1),
+        mapping(nullptr),
+        mapping_bytes(0) {
+}
+
+FrameRecording::~FrameRecording() {
+    close();
+}
+
+bool FrameRecording::open(const std::string& path) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void* address = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(RecordingHeader)) {
+        mapping_bytes = static_cast<size_t>(info.st_size);
+        address = mmap(nullptr, mapping_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    if (address == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mapping = static_cast<const uchar*>(address);
+
+    // Reject anything whose index or slots would reach past the file.
+    const RecordingHeader& head = header();
+    uint64_t slots = head.slot_count;
+    bool valid = std::memcmp(head.magic, "CALREC1", 8) == 0 && head.version == recording_version
+            && head.index_offset + slots * sizeof(RecordedFrameEntry) <= head.data_offset
+            && head.data_offset + slots * head.slot_bytes <= mapping_bytes;
+    if (!valid) {
+        close();
+        return false;
+    }
+    const RecordedFrameEntry* index = reinterpret_cast<const RecordedFrameEntry*>(mapping + head.index_offset);
+    for (uint64_t slot = 0; slot < slots; ++slot) {
+        const RecordedFrameEntry& entry = index[slot];
+        if (entry.sequence == 0 || entry.bytes > head.slot_bytes
+            || entry.bytes != static_cast<uint64_t>(entry.width)
+                              * frame_rows(cv::Size(entry.width, entry.height), static_cast<FrameFormat>(entry.format)))
+            continue;
+        entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const RecordedFrameEntry* a, const RecordedFrameEntry* b) {
+        return a->sequence < b->sequence;
+    });
+    return true;
+}
+
+void FrameRecording::close() {
+    if (mapping)
+        munmap(const_cast<uchar*>(mapping), mapping_bytes);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    mapping = nullptr;
+    mapping_bytes = 0;
+    entries.clear();
+}
+
+const RecordingHeader& FrameRecording::header() const {
+    return *reinterpret_cast<const RecordingHeader*>(mapping);
+}
+
+size_t FrameRecording::size() const {
+    return entries.size();
+}
+
+const RecordedFrameEntry& FrameRecording::entry(size_t i) const {
+    return *entries[i];
+}
+
+cv::Mat FrameRecording::frame(size_t i) const {
+    const RecordedFrameEntry& source = *entries[i];
+    const RecordingHeader& head = header();
+    size_t slot = static_cast<size_t>((source.sequence - 1) % head.slot_count);
+    int rows = frame_rows(cv::Size(source.width, source.height), static_cast<FrameFormat>(source.format));
+    return cv::Mat(rows, static_cast<int>(source.width), CV_8UC1,
+                   const_cast<uchar*>(mapping + head.data_offset + slot * head.slot_bytes));
+}
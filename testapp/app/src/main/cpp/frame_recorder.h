@@ -0,0 +1,152 @@
+#ifndef TESTAPP_FRAME_RECORDER_H
+#define TESTAPP_FRAME_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Recording file layout, little-endian: the header, then `slot_count` index
+// entries, then `slot_count` page-aligned slots of `slot_bytes` each. Frame n
+// (1-based sequence) lives in slot (n - 1) % slot_count, so once the ring is
+// full the oldest frames are overwritten. An entry with sequence 0 is empty or
+// was being written when the recording stopped.
+enum class FrameFormat : uint32_t {
+    Y8 = 1,     // luma plane only, `height` rows
+    NV21 = 2    // luma plus interleaved VU, `height * 3 / 2` rows
+};
+
+struct RecordingHeader {
+    char magic[8];              // "CALREC1"
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t slot_bytes;
+    uint64_t index_offset;
+    uint64_t data_offset;
+    uint64_t frames_written;
+    uint64_t frames_dropped;
+    int64_t created_unix_ms;
+    char device[64];
+};
+
+struct RecordedFrameEntry {
+    uint64_t sequence;
+    int64_t timestamp_ns;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;            // FrameFormat
+    uint32_t flags;             // FrameRecorder::Snapshot, ...
+    uint64_t bytes;             // rows packed without padding
+};
+
+// Appends raw camera frames to a preallocated, memory-mapped ring file.
+// record() only copies the frame into one of a few preallocated staging
+// buffers and drops it when they are all taken; a background thread copies
+// staged frames into the mapping and updates the index. Nothing on the camera
+// thread allocates, waits on a lock or touches the file. record() expects a
+// single producer thread.
+class FrameRecorder {
+
+public:
+    enum Flags : uint32_t {
+        Snapshot = 1u << 0u    // a snapshot was requested on this frame
+    };
+
+    struct Options {
+        int slots;              // frames kept in the ring file
+        int staging;            // frames that can wait for the writer
+
+        Options():
+                slots(300),
+                staging(4)
+                {};
+    };
+
+    FrameRecorder();
+    ~FrameRecorder();
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    // Creates and preallocates the ring file for frames of `frame_size`.
+    bool start(const std::string& path, cv::Size frame_size, FrameFormat format,
+               const std::string& device, const Options& options = Options());
+    // Writes out the staged frames and closes the file. Returns the number of
+    // frames written, or -1 if nothing was recording.
+    long stop();
+
+    bool enabled() const {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    // `frame` is the CV_8UC1 Y plane, or the whole NV21 buffer. Returns false
+    // when the frame was dropped.
+    bool record(const cv::Mat& frame, int64_t timestamp_ns, uint32_t flags = 0);
+
+    uint64_t frames_written() const;
+    uint64_t frames_dropped() const;
+
+private:
+    struct Staged {
+        std::unique_ptr<uchar[]> data;
+        RecordedFrameEntry entry;
+    };
+
+    void writer_loop();
+    void write(const Staged& staged);
+
+    std::atomic<bool> active;
+    std::atomic<int> producers;
+    std::atomic<uint64_t> staged_head;
+    std::atomic<uint64_t> staged_tail;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> dropped;
+    std::vector<Staged> staging;
+    uint64_t next_sequence;
+
+    int fd;
+    uchar* mapping;
+    size_t mapping_bytes;
+    RecordingHeader* header;
+    RecordedFrameEntry* index;
+    cv::Size frame_size;
+    FrameFormat format;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stopping;
+    std::thread writer;
+};
+
+// Read-only mapping of a recording, with the frames still in the ring in
+// sequence order. Frames are views into the mapping and stay valid while the
+// recording is open.
+class FrameRecording {
+
+public:
+    FrameRecording();
+    ~FrameRecording();
+    FrameRecording(const FrameRecording&) = delete;
+    FrameRecording& operator=(const FrameRecording&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const RecordingHeader& header() const;
+    size_t size() const;
+    const RecordedFrameEntry& entry(size_t i) const;
+    // CV_8UC1, `height` rows for Y8 and `height * 3 / 2` for NV21.
+    cv::Mat frame(size_t i) const;
+
+private:
+    int fd;
+    const uchar* mapping;
+    size_t mapping_bytes;
+    std::vector<const RecordedFrameEntry*> entries;
+};
+
+#endif //TESTAPP_FRAME_RECORDER_H
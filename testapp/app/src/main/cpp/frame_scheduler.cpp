@@ -0,0 +1,78 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+
+namespace {
+
+const double smoothing = 0.2;
+
+}
+
+FrameScheduler::FrameScheduler(const Options& options):
+        options(options),
+        budget_us(33333),
+        enabled(false),
+        average_us(0),
+        over(0),
+        under(0),
+        current(0),
+        level_changes(0),
+        published_average_us(0) {
+}
+
+void FrameScheduler::set_budget(std::chrono::microseconds budget) {
+    budget_us.store(std::max<int64_t>(1, budget.count()), std::memory_order_relaxed);
+}
+
+void FrameScheduler::set_enabled(bool scheduling) {
+    enabled.store(scheduling, std::memory_order_relaxed);
+}
+
+int FrameScheduler::frame_done(std::chrono::steady_clock::duration elapsed) {
+    double us = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    average_us = average_us == 0 ? us : average_us + smoothing * (us - average_us);
+    published_average_us.store(static_cast<int64_t>(average_us), std::memory_order_relaxed);
+    if (!enabled.load(std::memory_order_relaxed)) {
+        // Full quality, and a clean slate for the next enable.
+        over = under = 0;
+        current.store(0, std::memory_order_relaxed);
+        return 0;
+    }
+
+    int level = current.load(std::memory_order_relaxed);
+    double budget = static_cast<double>(budget_us.load(std::memory_order_relaxed));
+    over = average_us > options.degrade_at * budget ? over + 1 : 0;
+    under = average_us < options.restore_at * budget ? under + 1 : 0;
+    int next = level;
+    if (over >= options.degrade_after && level + 1 < options.levels)
+        next = level + 1;
+    else if (under >= options.restore_after && level > 0)
+        next = level - 1;
+    if (next != level) {
+        // The cheaper (or richer) level changes the cost; judge it on fresh samples.
+        over = under = 0;
+        average_us = 0;
+        current.store(next, std::memory_order_relaxed);
+        level_changes.fetch_add(1, std::memory_order_relaxed);
+    }
+    return next;
+}
+
+int FrameScheduler::level() const {
+    return current.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameScheduler::changes() const {
+    return level_changes.load(std::memory_order_relaxed);
+}
+
+double FrameScheduler::average_ms() const {
+    return published_average_us.load(std::memory_order_relaxed) / 1000.0;
+}
+
+void FrameScheduler::reset() {
+    average_us = 0;
+    over = under = 0;
+    current.store(0, std::memory_order_relaxed);
+    published_average_us.store(0, std::memory_order_relaxed);
+}
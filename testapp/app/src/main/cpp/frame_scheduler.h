@@ -0,0 +1,59 @@
+#ifndef TESTAPP_FRAME_SCHEDULER_H
+#define TESTAPP_FRAME_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Picks a quality level for a per-frame path from its measured cost. Level 0
+// is full quality; each higher level is cheaper. The cost is smoothed with an
+// exponential moving average: above `degrade_at` of the frame budget for a few
+// frames the level goes up one step, below `restore_at` for a longer stretch it
+// comes back down, so a single slow frame does not make it oscillate.
+// Off until enabled: every frame gets level 0. The budget and the switch may
+// be set from any thread; frame_done() and reset() belong to the frame thread.
+class FrameScheduler {
+
+public:
+    struct Options {
+        int levels;
+        double degrade_at;
+        double restore_at;
+        int degrade_after;  // consecutive frames over budget
+        int restore_after;  // consecutive frames with headroom
+
+        Options():
+                levels(4),
+                degrade_at(0.9),
+                restore_at(0.5),
+                degrade_after(3),
+                restore_after(30)
+                {};
+    };
+
+    explicit FrameScheduler(const Options& options = Options());
+
+    void set_budget(std::chrono::microseconds budget);
+    void set_enabled(bool enabled);
+    // Feeds one frame's cost; returns the level for the next frame.
+    int frame_done(std::chrono::steady_clock::duration elapsed);
+
+    // Readable from any thread for the stats surface.
+    int level() const;
+    uint64_t changes() const;
+    double average_ms() const;
+    void reset();
+
+private:
+    Options options;
+    std::atomic<int64_t> budget_us;
+    std::atomic<bool> enabled;
+    double average_us;
+    int over;
+    int under;
+    std::atomic<int> current;
+    std::atomic<uint64_t> level_changes;
+    std::atomic<int64_t> published_average_us;
+};
+
+#endif //TESTAPP_FRAME_SCHEDULER_H
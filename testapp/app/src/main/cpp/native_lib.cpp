@@ -1,3 +1,4 @@
+#include <cmath>
 #include <jni.h>
 #include <android/log.h>
 #include <opencv2/core/core.hpp>
@@ -11,12 +12,29 @@
 #include <opencv2/highgui.hpp>
 
 #include "camera_calibration.h"
+#include "frame_recorder.h"
+#include "thread_pool.h"
+#include "trace_recorder.h"
 
-CameraCalibration camera_calibration = CameraCalibration();
+CameraCalibration camera_calibration;
+FrameRecorder frame_recorder;
+
+// Camera callbacks arrive on a bridge thread we do not own; pin it to the big
+// cores the first time it calls in, or after the pool was reconfigured.
+static void pin_latency_thread() {
+    static thread_local std::shared_ptr<ThreadPool> pinned_for;
+    std::shared_ptr<ThreadPool> pool = ThreadPool::shared();
+    if (pinned_for != pool) {
+        pool->pin_current_thread(Lane::Latency);
+        pinned_for = pool;
+    }
+}
 
 extern "C" JNIEXPORT jint JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_identifyChessboard(
         JNIEnv *env, jobject instance, jlong mat_addr, jboolean mode_take_snapshot) {
 
+    TraceSpan span("identifyChessboard", "jni");
+    pin_latency_thread();
     cv::Mat& frame = *(cv::Mat *) mat_addr;
     return camera_calibration.identify_chessboard(frame, reinterpret_cast<bool&>(mode_take_snapshot));
 }
@@ -33,6 +51,7 @@ extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCamera
 extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_calibrate(
         JNIEnv *env,jobject instance, jlong matrix_addr, jlong dist_addr){
 
+    TraceSpan span("calibrate", "jni");
     cv::Mat& matrix = *(cv::Mat *) matrix_addr;
     cv::Mat& dist = *(cv::Mat *) dist_addr;
 
@@ -45,9 +64,276 @@ extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCamera
 extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screenundistort_UndistortViewListener_undistort(
         JNIEnv *env, jobject instance, jlong mat_addr, jlong matrix_addr, jlong dist_addr) {
 
+    TraceSpan span("undistort", "jni");
+    pin_latency_thread();
     cv::Mat& frame = *(cv::Mat *) mat_addr;
     cv::Mat& matrix = *(cv::Mat *) matrix_addr;
     cv::Mat& dist = *(cv::Mat *) dist_addr;
 
-    CameraCalibration::undistort_image(frame, matrix, dist);
-}
\ No newline at end of file
+    camera_calibration.undistort_image(frame, matrix, dist);
+}
+
+extern "C" JNIEXPORT jdoubleArray JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_getStats(
+        JNIEnv *env, jobject instance) {
+
+    std::vector<double> values = camera_calibration.stats_snapshot().to_array();
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    env->SetDoubleArrayRegion(result, 0, values.size(), values.data());
+    return result;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_resetStats(
+        JNIEnv *env, jobject instance) {
+
+    camera_calibration.reset_stats();
+}
+
+extern "C" JNIEXPORT jboolean JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_startTrace(
+        JNIEnv *env, jobject instance, jstring path) {
+
+    const char* chars = env->GetStringUTFChars(path, nullptr);
+    bool started = TraceRecorder::instance().start(chars);
+    env->ReleaseStringUTFChars(path, chars);
+    return started ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_stopTrace(
+        JNIEnv *env, jobject instance) {
+
+    return TraceRecorder::instance().stop();
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_configureThreadPool(
+        JNIEnv *env, jobject instance, jint latency_workers, jint background_workers, jboolean pin_threads) {
+
+    ThreadPool::Config config = ThreadPool::Config::defaults();
+    if (latency_workers >= 0)
+        config.latency_workers = latency_workers;
+    if (background_workers >= 0)
+        config.background_workers = background_workers;
+    config.pin_threads = pin_threads;
+    ThreadPool::configure_shared(config);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_configureCalibration(
+        JNIEnv *env, jobject instance, jint solver, jint max_views) {
+
+    camera_calibration.set_solver(static_cast<CalibrationSolver>(solver), static_cast<size_t>(max_views));
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_configureLensModel(
+        JNIEnv *env, jobject instance, jint lens, jdouble balance, jdouble fov_scale) {
+
+    camera_calibration.set_lens_model(static_cast<LensModel>(lens), balance, fov_scale);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_configureTarget(
+        JNIEnv *env, jobject instance, jint pattern) {
+
+    camera_calibration.set_target(static_cast<TargetPattern>(pattern));
+}
+
+extern "C" JNIEXPORT jstring JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_distortionModel(
+        JNIEnv *env, jobject instance) {
+
+    return env->NewStringUTF(camera_calibration.selected_distortion_model().c_str());
+}
+
+static jdoubleArray solve_report(JNIEnv *env, const SolveReport& report, jlong matrix_addr, jlong dist_addr) {
+    *(cv::Mat *) matrix_addr = report.camera_matrix;
+    *(cv::Mat *) dist_addr = report.dist_coeffs;
+    jdouble values[] = {report.rms, report.seconds};
+    jdoubleArray result = env->NewDoubleArray(2);
+    env->SetDoubleArrayRegion(result, 0, 2, values);
+    return result;
+}
+
+extern "C" JNIEXPORT jdoubleArray JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_calibrateFast(
+        JNIEnv *env, jobject instance, jlong matrix_addr, jlong dist_addr, jboolean refine) {
+
+    TraceSpan span("calibrate_fast", "jni");
+    SolveReport report = camera_calibration.calibrate_fast();
+    if (refine && !std::isnan(report.rms))
+        camera_calibration.refine_in_background(report);
+    return solve_report(env, report, matrix_addr, dist_addr);
+}
+
+extern "C" JNIEXPORT jdoubleArray JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_pollRefinement(
+        JNIEnv *env, jobject instance, jlong matrix_addr, jlong dist_addr) {
+
+    if (!camera_calibration.refinement_ready())
+        return nullptr;
+    return solve_report(env, camera_calibration.refined_result(), matrix_addr, dist_addr);
+}
+
+extern "C" JNIEXPORT jdoubleArray JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_bootstrapCalibration(
+        JNIEnv *env, jobject instance, jlong matrix_addr, jlong dist_addr, jint samples) {
+
+    TraceSpan span("bootstrap", "jni");
+    cv::Mat& matrix = *(cv::Mat *) matrix_addr;
+    cv::Mat& dist = *(cv::Mat *) dist_addr;
+
+    std::vector<double> values = camera_calibration.bootstrap(matrix, dist, samples).to_array();
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    env->SetDoubleArrayRegion(result, 0, values.size(), values.data());
+    return result;
+}
+
+// Points travel as interleaved x, y floats. Null before the image size is
+// known, as there is no table to map through.
+static jfloatArray map_points(JNIEnv *env, jlong matrix_addr, jlong dist_addr, jfloatArray points, bool undistort) {
+    cv::Mat& matrix = *(cv::Mat *) matrix_addr;
+    cv::Mat& dist = *(cv::Mat *) dist_addr;
+
+    jsize length = env->GetArrayLength(points);
+    std::vector<cv::Point2f> src(length / 2), dst;
+    env->GetFloatArrayRegion(points, 0, src.size() * 2, reinterpret_cast<jfloat*>(src.data()));
+    try {
+        if (undistort)
+            camera_calibration.undistort_points(src, dst, matrix, dist);
+        else
+            camera_calibration.distort_points(src, dst, matrix, dist);
+    } catch (const cv::Exception&) {
+        return nullptr;
+    }
+
+    jfloatArray result = env->NewFloatArray(dst.size() * 2);
+    env->SetFloatArrayRegion(result, 0, dst.size() * 2, reinterpret_cast<const jfloat*>(dst.data()));
+    return result;
+}
+
+extern "C" JNIEXPORT jfloatArray JNICALL Java_com_example_testapp_screenundistort_UndistortViewListener_undistortPoints(
+        JNIEnv *env, jobject instance, jlong matrix_addr, jlong dist_addr, jfloatArray points) {
+
+    return map_points(env, matrix_addr, dist_addr, points, true);
+}
+
+extern "C" JNIEXPORT jfloatArray JNICALL Java_com_example_testapp_screenundistort_UndistortViewListener_distortPoints(
+        JNIEnv *env, jobject instance, jlong matrix_addr, jlong dist_addr, jfloatArray points) {
+
+    return map_points(env, matrix_addr, dist_addr, points, false);
+}
+
+extern "C" JNIEXPORT jfloatArray JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_boardPose(
+        JNIEnv *env, jobject instance, jlong matrix_addr, jlong dist_addr) {
+
+    cv::Mat& matrix = *(cv::Mat *) matrix_addr;
+    cv::Mat& dist = *(cv::Mat *) dist_addr;
+
+    std::array<float, 9> values = camera_calibration.board_pose(matrix, dist).to_array();
+    jfloatArray result = env->NewFloatArray(values.size());
+    env->SetFloatArrayRegion(result, 0, values.size(), values.data());
+    return result;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_configureDetection(
+        JNIEnv *env, jobject instance, jint workers) {
+
+    camera_calibration.set_detection_workers(workers);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_configureFrameBudget(
+        JNIEnv *env, jobject instance, jlong budget_us, jboolean adaptive) {
+
+    camera_calibration.set_frame_budget(std::chrono::microseconds(budget_us));
+    camera_calibration.set_adaptive_quality(adaptive);
+}
+
+static std::string to_string(JNIEnv *env, jstring value) {
+    const char* chars = env->GetStringUTFChars(value, nullptr);
+    std::string result(chars);
+    env->ReleaseStringUTFChars(value, chars);
+    return result;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_collectTuningFrames(
+        JNIEnv *env, jobject instance, jint count) {
+
+    camera_calibration.collect_tuning_frames(static_cast<size_t>(std::max(0, count)));
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_tuningFramesCollected(
+        JNIEnv *env, jobject instance) {
+
+    return static_cast<jint>(camera_calibration.tuning_frames_collected());
+}
+
+extern "C" JNIEXPORT jdoubleArray JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_nativeAutotuneDetection(
+        JNIEnv *env, jobject instance, jstring path, jstring device) {
+
+    TraceSpan span("autotune", "jni");
+    DetectionTuning tuning = camera_calibration.tune_detection();
+    bool saved = tuning.frames > 0 && tuning.best.save(to_string(env, path), to_string(env, device));
+    const DetectionConfig& best = tuning.best;
+    jdouble values[] = {static_cast<double>(tuning.frames), tuning.square_px,
+                        static_cast<double>(best.flags), static_cast<double>(best.pyramid_level),
+                        static_cast<double>(best.subpix_window), static_cast<double>(best.subpix_iterations),
+                        best.subpix_epsilon, saved ? 1.0 : 0.0};
+    jdoubleArray result = env->NewDoubleArray(8);
+    env->SetDoubleArrayRegion(result, 0, 8, values);
+    return result;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_loadDetectionConfig(
+        JNIEnv *env, jobject instance, jstring path, jstring device) {
+
+    DetectionConfig config;
+    if (!DetectionConfig::load(to_string(env, path), to_string(env, device), config))
+        return JNI_FALSE;
+    camera_calibration.set_detection_config(config);
+    return JNI_TRUE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_startRecording(
+        JNIEnv *env, jobject instance, jstring path, jint width, jint height, jstring device, jint slots) {
+
+    FrameRecorder::Options options;
+    options.slots = slots;
+    bool started = frame_recorder.start(to_string(env, path), cv::Size(width, height), FrameFormat::Y8,
+                                        to_string(env, device), options);
+    return started ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_recordFrame(
+        JNIEnv *env, jobject instance, jlong mat_addr, jlong timestamp_ns, jint flags) {
+
+    TraceSpan span("record_frame", "jni");
+    frame_recorder.record(*(cv::Mat *) mat_addr, timestamp_ns, static_cast<uint32_t>(flags));
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_stopRecording(
+        JNIEnv *env, jobject instance) {
+
+    return frame_recorder.stop();
+}
+
+extern "C" JNIEXPORT jboolean JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_saveDataset(
+        JNIEnv *env, jobject instance, jstring path, jstring device) {
+
+    TraceSpan span("save_dataset", "jni");
+    CalibrationDataset dataset = camera_calibration.dataset();
+    dataset.device = to_string(env, device);
+    return dataset.save(to_string(env, path)) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_configureSnapshotImages(
+        JNIEnv *env, jobject instance, jstring directory, jint capacity, jboolean drop_oldest,
+        jint jpeg_quality, jdouble scale, jboolean png) {
+
+    SnapshotWriter::Options options;
+    options.capacity = capacity;
+    options.drop = drop_oldest ? SnapshotWriter::DropPolicy::Oldest : SnapshotWriter::DropPolicy::Newest;
+    options.jpeg_quality = jpeg_quality;
+    options.scale = scale;
+    options.extension = png ? ".png" : ".jpg";
+    return camera_calibration.set_snapshot_output(to_string(env, directory), options) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jdoubleArray JNICALL Java_com_example_testapp_screencamera_CvCameraViewListener_getSnapshotImageStats(
+        JNIEnv *env, jobject instance) {
+
+    std::array<double, 7> values = camera_calibration.snapshot_output_stats().to_array();
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    env->SetDoubleArrayRegion(result, 0, values.size(), values.data());
+    return result;
+}
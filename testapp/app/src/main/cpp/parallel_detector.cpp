@@ -0,0 +1,101 @@
+#include "parallel_detector.h"
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ParallelDetector::ParallelDetector(int workers, DetectFunction detect, PipelineStats& stats,
+                                   cv::MatAllocator* allocator):
+        detect(std::move(detect)),
+        stats(stats),
+        slots(std::max(1, workers)),
+        next_slot(0),
+        next_sequence(0),
+        delivered(-1),
+        in_flight(0) {
+    for (Worker& worker : slots)
+        worker.gray.allocator = allocator;
+}
+
+ParallelDetector::~ParallelDetector() {
+    for (Worker& worker : slots)
+        if (worker.pending.valid())
+            worker.pending.wait();
+}
+
+bool ParallelDetector::submit(const FillFunction& fill, Refinement refinement, int crop_margin,
+                              const cv::Mat& keep) {
+    int64_t sequence = next_sequence++;
+    for (size_t tried = 0; tried < slots.size(); ++tried) {
+        Worker& worker = slots[(next_slot + tried) % slots.size()];
+        if (busy(worker))
+            continue;
+        next_slot = (next_slot + tried + 1) % slots.size();
+        if (worker.pending.valid())
+            worker.pending.get();
+        fill(worker.gray);
+        if (keep.empty())
+            worker.frame.release();
+        else
+            keep.copyTo(worker.frame);
+        Worker* target = &worker;
+        TraceRecorder::instance().counter("detections_in_flight", in_flight.fetch_add(1) + 1);
+        worker.pending = ThreadPool::shared()->submit(Lane::Latency, [this, target, sequence, refinement, crop_margin] {
+            TraceRecorder::set_frame(sequence);
+            auto start = std::chrono::steady_clock::now();
+            target->corners.clear();
+            bool found = detect(target->gray, target->corners, refinement);
+            target->crop = found && crop_margin > 0 ? crop_board(target->gray, target->corners, crop_margin) : BoardCrop();
+            complete(*target, sequence, found, refinement, crop_margin, std::chrono::steady_clock::now() - start);
+            TraceRecorder::instance().counter("detections_in_flight", in_flight.fetch_sub(1) - 1);
+        });
+        return true;
+    }
+    stats.frame_dropped();
+    return false;
+}
+
+bool ParallelDetector::poll(Result& result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (finished.empty())
+        return false;
+    std::vector<Result>::iterator newest = std::max_element(finished.begin(), finished.end(),
+            [](const Result& a, const Result& b) { return a.sequence < b.sequence; });
+    // Older finished frames are superseded by the newest one before being shown.
+    for (size_t i = 1; i < finished.size(); ++i)
+        stats.frame_dropped();
+    result = std::move(*newest);
+    delivered = result.sequence;
+    finished.clear();
+    return true;
+}
+
+int ParallelDetector::workers() const {
+    return static_cast<int>(slots.size());
+}
+
+bool ParallelDetector::busy(const Worker& worker) const {
+    return worker.pending.valid() &&
+           worker.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+void ParallelDetector::complete(Worker& worker, int64_t sequence, bool found, Refinement refinement,
+                                int crop_margin, std::chrono::steady_clock::duration detect_time) {
+    stats.detection(found);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sequence < delivered) {
+        stats.frame_dropped();
+        return;
+    }
+    Result result;
+    result.sequence = sequence;
+    result.found = found;
+    result.refinement = refinement;
+    result.crop_margin = crop_margin;
+    result.detect_time = detect_time;
+    result.corners = worker.corners;
+    result.crop = std::move(worker.crop);
+    // Moved, not shared: the next copy into the worker must not write into it.
+    result.frame = std::move(worker.frame);
+    finished.push_back(std::move(result));
+}
@@ -0,0 +1,81 @@
+#ifndef TESTAPP_PARALLEL_DETECTOR_H
+#define TESTAPP_PARALLEL_DETECTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "corner_refinement.h"
+#include "pipeline_stats.h"
+
+// Spreads chessboard detection of consecutive preview frames over several
+// latency-lane workers, each with its own gray and corner buffers, so the
+// detection rate is no longer capped at one frame per detector latency.
+// Frames go round-robin to the next free worker and are dropped when all are
+// busy. Results come back in frame order: poll() hands out the newest
+// finished frame after the last delivered one, and frames that finish after a
+// newer one was delivered are dropped as late.
+class ParallelDetector {
+
+public:
+    struct Result {
+        int64_t sequence;
+        bool found;
+        std::vector<cv::Point2f> corners;
+        Refinement refinement;  // as submitted
+        int crop_margin;        // as submitted
+        BoardCrop crop;         // only for found boards submitted with a crop margin
+        cv::Mat frame;          // the frame submitted to be kept, else empty
+        std::chrono::steady_clock::duration detect_time;  // on the worker
+    };
+
+    typedef std::function<void(cv::Mat& gray)> FillFunction;
+    typedef std::function<bool(const cv::Mat& gray, std::vector<cv::Point2f>& corners,
+                               Refinement refinement)> DetectFunction;
+
+    ParallelDetector(int workers, DetectFunction detect, PipelineStats& stats, cv::MatAllocator* allocator = nullptr);
+    // Waits for the detections in flight.
+    ~ParallelDetector();
+    ParallelDetector(const ParallelDetector&) = delete;
+    ParallelDetector& operator=(const ParallelDetector&) = delete;
+
+    // `fill` writes the frame's gray image into a free worker's buffer on the
+    // calling thread. With a positive `crop_margin` a found board's result
+    // carries its gray crop, and a non-empty `keep` is copied and comes back
+    // with the result, so it matches the corners. Returns false when the
+    // frame was dropped.
+    bool submit(const FillFunction& fill, Refinement refinement, int crop_margin = 0,
+                const cv::Mat& keep = cv::Mat());
+    bool poll(Result& result);
+    int workers() const;
+
+private:
+    struct Worker {
+        cv::Mat gray;
+        std::vector<cv::Point2f> corners;
+        BoardCrop crop;
+        cv::Mat frame;
+        std::future<void> pending;
+    };
+
+    DetectFunction detect;
+    PipelineStats& stats;
+    std::vector<Worker> slots;
+    size_t next_slot;
+    int64_t next_sequence;
+    int64_t delivered;
+    std::atomic<int> in_flight;  // traced as a counter
+    std::mutex mutex;
+    std::vector<Result> finished;
+
+    bool busy(const Worker& worker) const;
+    void complete(Worker& worker, int64_t sequence, bool found, Refinement refinement, int crop_margin,
+                  std::chrono::steady_clock::duration detect_time);
+};
+
+#endif //TESTAPP_PARALLEL_DETECTOR_H
@@ -0,0 +1,142 @@
+#include "pipeline_stats.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+double percentile_ms(const std::vector<uint32_t>& sorted_us, double fraction) {
+    if (sorted_us.empty())
+        return 0.0;
+    size_t index = static_cast<size_t>(fraction * (sorted_us.size() - 1) + 0.5);
+    return sorted_us[index] / 1000.0;
+}
+
+}
+
+const size_t PipelineStats::ring_capacity;
+const size_t PipelineStats::stage_count;
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::Gray: return "gray";
+        case Stage::Detect: return "detect";
+        case Stage::Refine: return "refine";
+        case Stage::Draw: return "draw";
+        case Stage::Remap: return "remap";
+        case Stage::Solve: return "solve";
+        case Stage::Pose: return "pose";
+        default: return "unknown";
+    }
+}
+
+double PipelineStats::Snapshot::hit_rate() const {
+    return detections_attempted ? static_cast<double>(detections_found) / detections_attempted : 0.0;
+}
+
+std::vector<double> PipelineStats::Snapshot::to_array() const {
+    std::vector<double> values {
+        static_cast<double>(frames_processed),
+        static_cast<double>(frames_dropped),
+        static_cast<double>(frames_late),
+        static_cast<double>(detections_attempted),
+        static_cast<double>(detections_found),
+        static_cast<double>(bytes_allocated),
+        static_cast<double>(bytes_in_use),
+        static_cast<double>(detection_level),
+        static_cast<double>(remap_level),
+        static_cast<double>(quality_changes),
+        hit_rate()
+    };
+    for (const StageSummary& stage : stages) {
+        values.push_back(static_cast<double>(stage.count));
+        values.push_back(stage.p50_ms);
+        values.push_back(stage.p95_ms);
+        values.push_back(stage.p99_ms);
+        values.push_back(stage.max_ms);
+    }
+    return values;
+}
+
+PipelineStats::PipelineStats():
+        frame_budget_us(33333) {
+    reset();
+}
+
+void PipelineStats::record(Stage stage, std::chrono::steady_clock::duration elapsed) {
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    uint32_t sample = static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(us, 0),
+                                                             std::numeric_limits<uint32_t>::max()));
+    Ring& ring = rings[static_cast<size_t>(stage)];
+    uint64_t slot = ring.written.fetch_add(1, std::memory_order_relaxed);
+    ring.samples_us[slot % ring_capacity].store(sample, std::memory_order_relaxed);
+}
+
+void PipelineStats::frame_processed(std::chrono::steady_clock::duration elapsed) {
+    frames_processed.fetch_add(1, std::memory_order_relaxed);
+    if (std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() >
+        frame_budget_us.load(std::memory_order_relaxed))
+        frames_late.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineStats::frame_dropped() {
+    frames_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineStats::detection(bool found) {
+    detections_attempted.fetch_add(1, std::memory_order_relaxed);
+    if (found)
+        detections_found.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineStats::set_frame_budget(std::chrono::microseconds budget) {
+    frame_budget_us.store(budget.count(), std::memory_order_relaxed);
+}
+
+void PipelineStats::reset() {
+    for (Ring& ring : rings) {
+        for (std::atomic<uint32_t>& sample : ring.samples_us)
+            sample.store(0, std::memory_order_relaxed);
+        ring.written.store(0, std::memory_order_relaxed);
+    }
+    frames_processed.store(0, std::memory_order_relaxed);
+    frames_dropped.store(0, std::memory_order_relaxed);
+    frames_late.store(0, std::memory_order_relaxed);
+    detections_attempted.store(0, std::memory_order_relaxed);
+    detections_found.store(0, std::memory_order_relaxed);
+}
+
+PipelineStats::Snapshot PipelineStats::snapshot(uint64_t bytes_allocated, uint64_t bytes_in_use) const {
+    Snapshot result;
+    result.frames_processed = frames_processed.load(std::memory_order_relaxed);
+    result.frames_dropped = frames_dropped.load(std::memory_order_relaxed);
+    result.frames_late = frames_late.load(std::memory_order_relaxed);
+    result.detections_attempted = detections_attempted.load(std::memory_order_relaxed);
+    result.detections_found = detections_found.load(std::memory_order_relaxed);
+    result.bytes_allocated = bytes_allocated;
+    result.bytes_in_use = bytes_in_use;
+    result.detection_level = 0;
+    result.remap_level = 0;
+    result.quality_changes = 0;
+
+    std::vector<uint32_t> samples;
+    samples.reserve(ring_capacity);
+    for (size_t i = 0; i < stage_count; ++i) {
+        const Ring& ring = rings[i];
+        uint64_t written = ring.written.load(std::memory_order_relaxed);
+        size_t available = static_cast<size_t>(std::min<uint64_t>(written, ring_capacity));
+
+        samples.clear();
+        for (size_t j = 0; j < available; ++j)
+            samples.push_back(ring.samples_us[j].load(std::memory_order_relaxed));
+        std::sort(samples.begin(), samples.end());
+
+        StageSummary& summary = result.stages[i];
+        summary.count = written;
+        summary.p50_ms = percentile_ms(samples, 0.50);
+        summary.p95_ms = percentile_ms(samples, 0.95);
+        summary.p99_ms = percentile_ms(samples, 0.99);
+        summary.max_ms = samples.empty() ? 0.0 : samples.back() / 1000.0;
+    }
+    return result;
+}
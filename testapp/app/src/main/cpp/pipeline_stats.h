@@ -0,0 +1,115 @@
+#ifndef TESTAPP_PIPELINE_STATS_H
+#define TESTAPP_PIPELINE_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "trace_recorder.h"
+
+enum class Stage {
+    Gray,
+    Detect,
+    Refine,
+    Draw,
+    Remap,
+    Solve,
+    Pose,
+    Count
+};
+
+const char* stage_name(Stage stage);
+
+// Lock-free per-stage timing and frame counters. Writers only do relaxed
+// atomic stores, so recording is safe from the camera threads while the UI
+// thread takes snapshots; a snapshot may miss samples written concurrently.
+class PipelineStats {
+
+public:
+    static const size_t ring_capacity = 256;
+    static const size_t stage_count = static_cast<size_t>(Stage::Count);
+
+    struct StageSummary {
+        uint64_t count;
+        double p50_ms;
+        double p95_ms;
+        double p99_ms;
+        double max_ms;
+    };
+
+    struct Snapshot {
+        uint64_t frames_processed;
+        uint64_t frames_dropped;
+        uint64_t frames_late;
+        uint64_t detections_attempted;
+        uint64_t detections_found;
+        uint64_t bytes_allocated;
+        uint64_t bytes_in_use;
+        // Frame scheduler levels (0 = full quality) and how often they changed.
+        uint64_t detection_level;
+        uint64_t remap_level;
+        uint64_t quality_changes;
+        std::array<StageSummary, stage_count> stages;
+
+        double hit_rate() const;
+        // Flat layout shared with PipelineStats.kt: ten counters followed by
+        // hit rate, then count/p50/p95/p99/max per stage in Stage order.
+        std::vector<double> to_array() const;
+    };
+
+    PipelineStats();
+
+    void record(Stage stage, std::chrono::steady_clock::duration elapsed);
+    void frame_processed(std::chrono::steady_clock::duration elapsed);
+    void frame_dropped();
+    void detection(bool found);
+    void set_frame_budget(std::chrono::microseconds budget);
+    void reset();
+
+    // Allocation figures come from the owner's allocator, not from the stages.
+    Snapshot snapshot(uint64_t bytes_allocated, uint64_t bytes_in_use) const;
+
+private:
+    struct Ring {
+        std::array<std::atomic<uint32_t>, ring_capacity> samples_us;
+        std::atomic<uint64_t> written;
+    };
+
+    std::array<Ring, stage_count> rings;
+    std::atomic<uint64_t> frames_processed;
+    std::atomic<uint64_t> frames_dropped;
+    std::atomic<uint64_t> frames_late;
+    std::atomic<uint64_t> detections_attempted;
+    std::atomic<uint64_t> detections_found;
+    std::atomic<int64_t> frame_budget_us;
+};
+
+// Records the lifetime of the enclosing block as one sample of a stage, and as
+// a trace span when the TraceRecorder is running.
+class StageTimer {
+
+public:
+    StageTimer(PipelineStats& stats, Stage stage):
+            stats(stats),
+            stage(stage),
+            start(std::chrono::steady_clock::now())
+            {};
+    ~StageTimer() {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        stats.record(stage, end - start);
+        TraceRecorder& tracer = TraceRecorder::instance();
+        if (tracer.enabled())
+            tracer.complete(stage_name(stage), "stage", start, end);
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    PipelineStats& stats;
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif //TESTAPP_PIPELINE_STATS_H
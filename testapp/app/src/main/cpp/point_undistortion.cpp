@@ -0,0 +1,184 @@
+#include "point_undistortion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include "thread_pool.h"
+
+namespace {
+
+// Default undistortPoints stops after 5 iterations, which is visibly off near
+// the corners of wide lenses; the table is built once, so let it converge.
+const cv::TermCriteria table_criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, 1e-10);
+
+}
+
+PointUndistortion::PointUndistortion(int cell_size):
+        cell_size(std::max(1, cell_size)),
+        error(0),
+        intrinsics(),
+        coefficients() {
+}
+
+void PointUndistortion::update(const cv::Mat& matrix, const cv::Mat& dist, const cv::Size& size) {
+    cv::Mat matrix64, dist64;
+    matrix.convertTo(matrix64, CV_64F);
+    if (!dist.empty())
+        dist.reshape(1, static_cast<int>(dist.total())).convertTo(dist64, CV_64F);
+    CV_Assert(matrix64.size() == cv::Size(3, 3) && dist64.total() <= 12);
+    // A 1x1 table would put the cell clamp below zero and the lookups past its end.
+    CV_Assert(size.area() > 0);
+
+    if (!lut_x.empty() && size == image_size && dist64.size() == dist_coeffs.size() &&
+        cv::norm(matrix64, camera_matrix, cv::NORM_INF) == 0 &&
+        (dist64.empty() || cv::norm(dist64, dist_coeffs, cv::NORM_INF) == 0))
+        return;
+
+    image_size = size;
+    camera_matrix = matrix64;
+    dist_coeffs = dist64;
+    intrinsics[0] = static_cast<float>(matrix64.at<double>(0, 0));
+    intrinsics[1] = static_cast<float>(matrix64.at<double>(1, 1));
+    intrinsics[2] = static_cast<float>(matrix64.at<double>(0, 2));
+    intrinsics[3] = static_cast<float>(matrix64.at<double>(1, 2));
+    std::fill(coefficients, coefficients + 12, 0.f);
+    for (int i = 0; i < dist64.rows; ++i)
+        coefficients[i] = static_cast<float>(dist64.at<double>(i));
+    build();
+}
+
+bool PointUndistortion::empty() const {
+    return lut_x.empty();
+}
+
+float PointUndistortion::max_error() const {
+    return error;
+}
+
+void PointUndistortion::build() {
+    int columns = (image_size.width + cell_size - 1) / cell_size + 1;
+    int rows = (image_size.height + cell_size - 1) / cell_size + 1;
+    lut_x.create(rows, columns, CV_32F);
+    lut_y.create(rows, columns, CV_32F);
+
+    ThreadPool::shared()->parallel_for_(Lane::Latency, cv::Range(0, rows), [&](const cv::Range& range) {
+        std::vector<cv::Point2f> nodes, undistorted;
+        for (int r = range.start; r < range.end; ++r)
+            for (int c = 0; c < columns; ++c)
+                nodes.emplace_back(static_cast<float>(c * cell_size), static_cast<float>(r * cell_size));
+        cv::undistortPoints(nodes, undistorted, camera_matrix, dist_coeffs, cv::noArray(), camera_matrix,
+                            table_criteria);
+        for (int r = range.start, i = 0; r < range.end; ++r)
+            for (int c = 0; c < columns; ++c, ++i) {
+                lut_x.at<float>(r, c) = undistorted[i].x;
+                lut_y.at<float>(r, c) = undistorted[i].y;
+            }
+    });
+
+    // Interpolation error peaks mid-cell; measure it there against the exact solve.
+    std::vector<cv::Point2f> centres, exact, interpolated;
+    for (int r = 0; r + 1 < rows; ++r)
+        for (int c = 0; c + 1 < columns; ++c)
+            centres.emplace_back((c + 0.5f) * cell_size, (r + 0.5f) * cell_size);
+    cv::undistortPoints(centres, exact, camera_matrix, dist_coeffs, cv::noArray(), camera_matrix, table_criteria);
+    interpolated.resize(centres.size());
+    undistort(centres.data(), interpolated.data(), centres.size());
+    error = 0;
+    for (size_t i = 0; i < centres.size(); ++i)
+        error = std::max(error, static_cast<float>(cv::norm(exact[i] - interpolated[i])));
+}
+
+void PointUndistortion::undistort(const cv::Point2f* src, cv::Point2f* dst, size_t count) const {
+    CV_Assert(!lut_x.empty());
+    const float* table_x = lut_x.ptr<float>();
+    const float* table_y = lut_y.ptr<float>();
+    const int stride = lut_x.cols;
+    const float inv_cell = 1.f / cell_size;
+    // Keeps the cell index one short of the last node, so idx + 1 and idx + stride stay in the table.
+    const float max_x = lut_x.cols - 1.0001f;
+    const float max_y = lut_x.rows - 1.0001f;
+    size_t i = 0;
+
+#if CV_SIMD
+    const int lanes = cv::v_float32::nlanes;
+    const cv::v_float32 v_inv_cell = cv::vx_setall_f32(inv_cell), v_zero = cv::vx_setzero_f32();
+    const cv::v_float32 v_max_x = cv::vx_setall_f32(max_x), v_max_y = cv::vx_setall_f32(max_y);
+    const cv::v_int32 v_stride = cv::vx_setall_s32(stride), v_one = cv::vx_setall_s32(1);
+    for (; i + lanes <= count; i += lanes) {
+        cv::v_float32 x, y;
+        cv::v_load_deinterleave(reinterpret_cast<const float*>(src + i), x, y);
+        cv::v_float32 gx = cv::v_min(cv::v_max(x * v_inv_cell, v_zero), v_max_x);
+        cv::v_float32 gy = cv::v_min(cv::v_max(y * v_inv_cell, v_zero), v_max_y);
+        cv::v_int32 ix = cv::v_trunc(gx), iy = cv::v_trunc(gy);
+        cv::v_float32 wx = gx - cv::v_cvt_f32(ix), wy = gy - cv::v_cvt_f32(iy);
+        cv::v_int32 top = iy * v_stride + ix, bottom = top + v_stride;
+
+        cv::v_float32 out[2];
+        const float* tables[2] = {table_x, table_y};
+        for (int axis = 0; axis < 2; ++axis) {
+            cv::v_float32 a = cv::v_lut(tables[axis], top), b = cv::v_lut(tables[axis], top + v_one);
+            cv::v_float32 c = cv::v_lut(tables[axis], bottom), d = cv::v_lut(tables[axis], bottom + v_one);
+            cv::v_float32 upper = cv::v_muladd(b - a, wx, a), lower = cv::v_muladd(d - c, wx, c);
+            out[axis] = cv::v_muladd(lower - upper, wy, upper);
+        }
+        cv::v_store_interleave(reinterpret_cast<float*>(dst + i), out[0], out[1]);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        float gx = std::min(std::max(src[i].x * inv_cell, 0.f), max_x);
+        float gy = std::min(std::max(src[i].y * inv_cell, 0.f), max_y);
+        int ix = static_cast<int>(gx), iy = static_cast<int>(gy);
+        float wx = gx - ix, wy = gy - iy;
+        int top = iy * stride + ix, bottom = top + stride;
+        float upper_x = table_x[top] + (table_x[top + 1] - table_x[top]) * wx;
+        float lower_x = table_x[bottom] + (table_x[bottom + 1] - table_x[bottom]) * wx;
+        float upper_y = table_y[top] + (table_y[top + 1] - table_y[top]) * wx;
+        float lower_y = table_y[bottom] + (table_y[bottom + 1] - table_y[bottom]) * wx;
+        dst[i] = cv::Point2f(upper_x + (lower_x - upper_x) * wy, upper_y + (lower_y - upper_y) * wy);
+    }
+}
+
+void PointUndistortion::distort(const cv::Point2f* src, cv::Point2f* dst, size_t count) const {
+    CV_Assert(!camera_matrix.empty());
+    const float fx = intrinsics[0], fy = intrinsics[1], cx = intrinsics[2], cy = intrinsics[3];
+    const float* k = coefficients;
+    size_t i = 0;
+
+#if CV_SIMD
+    const int lanes = cv::v_float32::nlanes;
+    const cv::v_float32 v_fx = cv::vx_setall_f32(fx), v_fy = cv::vx_setall_f32(fy);
+    const cv::v_float32 v_inv_fx = cv::vx_setall_f32(1.f / fx), v_inv_fy = cv::vx_setall_f32(1.f / fy);
+    const cv::v_float32 v_cx = cv::vx_setall_f32(cx), v_cy = cv::vx_setall_f32(cy);
+    const cv::v_float32 one = cv::vx_setall_f32(1.f), two = cv::vx_setall_f32(2.f);
+    cv::v_float32 v_k[12];
+    for (int j = 0; j < 12; ++j)
+        v_k[j] = cv::vx_setall_f32(k[j]);
+    for (; i + lanes <= count; i += lanes) {
+        cv::v_float32 u, v;
+        cv::v_load_deinterleave(reinterpret_cast<const float*>(src + i), u, v);
+        cv::v_float32 x = (u - v_cx) * v_inv_fx, y = (v - v_cy) * v_inv_fy;
+        cv::v_float32 x2 = x * x, y2 = y * y, xy = x * y;
+        cv::v_float32 r2 = x2 + y2, r4 = r2 * r2, r6 = r4 * r2;
+        cv::v_float32 numerator = one + v_k[0] * r2 + v_k[1] * r4 + v_k[4] * r6;
+        cv::v_float32 denominator = one + v_k[5] * r2 + v_k[6] * r4 + v_k[7] * r6;
+        cv::v_float32 radial = numerator / denominator;
+        cv::v_float32 xd = x * radial + two * v_k[2] * xy + v_k[3] * (r2 + two * x2) + v_k[8] * r2 + v_k[9] * r4;
+        cv::v_float32 yd = y * radial + v_k[2] * (r2 + two * y2) + two * v_k[3] * xy + v_k[10] * r2 + v_k[11] * r4;
+        cv::v_store_interleave(reinterpret_cast<float*>(dst + i), cv::v_muladd(xd, v_fx, v_cx),
+                               cv::v_muladd(yd, v_fy, v_cy));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        float x = (src[i].x - cx) / fx, y = (src[i].y - cy) / fy;
+        float x2 = x * x, y2 = y * y, xy = x * y;
+        float r2 = x2 + y2, r4 = r2 * r2, r6 = r4 * r2;
+        float radial = (1 + k[0] * r2 + k[1] * r4 + k[4] * r6) / (1 + k[5] * r2 + k[6] * r4 + k[7] * r6);
+        float xd = x * radial + 2 * k[2] * xy + k[3] * (r2 + 2 * x2) + k[8] * r2 + k[9] * r4;
+        float yd = y * radial + k[2] * (r2 + 2 * y2) + 2 * k[3] * xy + k[10] * r2 + k[11] * r4;
+        dst[i] = cv::Point2f(xd * fx + cx, yd * fy + cy);
+    }
+}
@@ -0,0 +1,222 @@
+#include "snapshot_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "thread_pool.h"
+#include "trace_recorder.h"
+
+std::array<double, 7> SnapshotWriter::Stats::to_array() const {
+    return {static_cast<double>(written), static_cast<double>(dropped), static_cast<double>(failed),
+            static_cast<double>(queue_depth), static_cast<double>(max_queue_depth), mean_write_ms, max_write_ms};
+}
+
+SnapshotWriter::SnapshotWriter():
+        active(false),
+        producers(0),
+        slot_count(0),
+        next_sequence(0),
+        written(0),
+        dropped(0),
+        failed(0),
+        max_depth(0),
+        total_write_ms(0),
+        max_write_ms(0),
+        stopping(false) {
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    stop();
+}
+
+bool SnapshotWriter::start(const std::string& output_directory, const Options& writer_options) {
+    if (active.load() || writer.joinable() || output_directory.empty() || writer_options.capacity <= 0
+        || writer_options.scale <= 0 || writer_options.scale > 1)
+        return false;
+    options = writer_options;
+    directory = output_directory;
+    slot_count = options.capacity;
+    slots.reset(new Slot[slot_count]);
+    for (int i = 0; i < slot_count; ++i) {
+        slots[i].state.store(Free);
+        slots[i].sequence.store(0);
+        // The frames outlive the frame arena scope they are copied in.
+        slots[i].image.allocator = cv::Mat::getStdAllocator();
+    }
+    next_sequence = 0;
+    written.store(0);
+    dropped.store(0);
+    failed.store(0);
+    max_depth.store(0);
+    total_write_ms = max_write_ms = 0;
+    stopping = false;
+    writer = std::thread(&SnapshotWriter::writer_loop, this);
+    active.store(true, std::memory_order_release);
+    return true;
+}
+
+void SnapshotWriter::stop() {
+    // seq_cst on both sides of the handshake with the producer's check below.
+    if (!active.exchange(false, std::memory_order_seq_cst))
+        return;
+    while (producers.load(std::memory_order_seq_cst) != 0)
+        std::this_thread::yield();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_one();
+    writer.join();
+}
+
+bool SnapshotWriter::submit(const cv::Mat& frame, int index) {
+    if (!enabled())
+        return false;
+    // Keeps stop() from joining the writer while a slot is being filled; the
+    // register-then-check handshake with stop() needs seq_cst on both sides.
+    producers.fetch_add(1, std::memory_order_seq_cst);
+    Slot* slot = active.load(std::memory_order_seq_cst) ? claim_slot() : nullptr;
+    if (slot) {
+        frame.copyTo(slot->image);
+        slot->index = index;
+        slot->submitted = std::chrono::steady_clock::now();
+        slot->sequence.store(++next_sequence, std::memory_order_relaxed);
+        slot->state.store(Ready, std::memory_order_release);
+
+        int depth = queue_depth();
+        TraceRecorder::instance().counter("snapshot_queue", depth);
+        int deepest = max_depth.load(std::memory_order_relaxed);
+        while (depth > deepest && !max_depth.compare_exchange_weak(deepest, depth)) {}
+    }
+    producers.fetch_sub(1, std::memory_order_release);
+    if (!slot) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Unlocked notify: a missed wake-up delays the write by one poll interval at most.
+    ready.notify_one();
+    return true;
+}
+
+SnapshotWriter::Stats SnapshotWriter::stats() const {
+    Stats result;
+    result.written = written.load();
+    result.dropped = dropped.load();
+    result.failed = failed.load();
+    result.queue_depth = enabled() ? queue_depth() : 0;
+    result.max_queue_depth = max_depth.load();
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    uint64_t finished = result.written + result.failed;
+    result.mean_write_ms = finished ? total_write_ms / finished : 0.0;
+    result.max_write_ms = max_write_ms;
+    return result;
+}
+
+SnapshotWriter::Slot* SnapshotWriter::claim_slot() {
+    for (int i = 0; i < slot_count; ++i) {
+        int expected = Free;
+        if (slots[i].state.compare_exchange_strong(expected, Filling, std::memory_order_acquire))
+            return &slots[i];
+    }
+    if (options.drop != DropPolicy::Oldest)
+        return nullptr;
+    // The exchange fails if the writer picked the slot up in the meantime.
+    for (;;) {
+        Slot* oldest = nullptr;
+        for (int i = 0; i < slot_count; ++i)
+            if (slots[i].state.load(std::memory_order_acquire) == Ready
+                && (!oldest || slots[i].sequence.load(std::memory_order_relaxed)
+                               < oldest->sequence.load(std::memory_order_relaxed)))
+                oldest = &slots[i];
+        if (!oldest)
+            return nullptr;
+        int expected = Ready;
+        if (oldest->state.compare_exchange_strong(expected, Filling, std::memory_order_acquire)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return oldest;
+        }
+    }
+}
+
+SnapshotWriter::Slot* SnapshotWriter::next_ready() {
+    for (;;) {
+        Slot* oldest = nullptr;
+        uint64_t oldest_sequence = 0;
+        for (int i = 0; i < slot_count; ++i) {
+            if (slots[i].state.load(std::memory_order_acquire) != Ready)
+                continue;
+            uint64_t sequence = slots[i].sequence.load(std::memory_order_relaxed);
+            if (!oldest || sequence < oldest_sequence) {
+                oldest = &slots[i];
+                oldest_sequence = sequence;
+            }
+        }
+        if (!oldest)
+            return nullptr;
+        int expected = Ready;
+        if (oldest->state.compare_exchange_strong(expected, Writing, std::memory_order_acquire))
+            return oldest;
+    }
+}
+
+int SnapshotWriter::queue_depth() const {
+    int depth = 0;
+    for (int i = 0; i < slot_count; ++i)
+        depth += slots[i].state.load(std::memory_order_relaxed) != Free;
+    return depth;
+}
+
+bool SnapshotWriter::has_ready() const {
+    for (int i = 0; i < slot_count; ++i)
+        if (slots[i].state.load(std::memory_order_acquire) == Ready)
+            return true;
+    return false;
+}
+
+void SnapshotWriter::writer_loop() {
+    ThreadPool::shared()->pin_current_thread(Lane::Background);
+    for (;;) {
+        bool finish;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait_for(lock, std::chrono::milliseconds(20), [this] { return stopping || has_ready(); });
+            finish = stopping;
+        }
+        while (Slot* slot = next_ready())
+            write(*slot);
+        if (finish)
+            return;
+    }
+}
+
+void SnapshotWriter::write(Slot& slot) {
+    TraceSpan span("write_snapshot");
+    cv::Mat scaled, bgr;
+    if (options.scale < 1)
+        cv::resize(slot.image, scaled, cv::Size(), options.scale, options.scale, cv::INTER_AREA);
+    else
+        scaled = slot.image;
+    cv::cvtColor(scaled, bgr, slot.image.channels() == 4 ? cv::COLOR_RGBA2BGR : cv::COLOR_RGB2BGR);
+
+    char name[32];
+    snprintf(name, sizeof(name), "/snapshot_%03d", slot.index);
+    std::vector<int> params;
+    if (options.extension == ".jpg")
+        params = {cv::IMWRITE_JPEG_QUALITY, options.jpeg_quality};
+    bool saved;
+    try {
+        saved = cv::imwrite(directory + name + options.extension, bgr, params);
+    } catch (const cv::Exception&) {
+        saved = false;
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - slot.submitted).count();
+    slot.state.store(Free, std::memory_order_release);
+    TraceRecorder::instance().counter("snapshot_queue", queue_depth());
+
+    (saved ? written : failed).fetch_add(1);
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    total_write_ms += elapsed_ms;
+    max_write_ms = std::max(max_write_ms, elapsed_ms);
+}
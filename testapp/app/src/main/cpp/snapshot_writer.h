@@ -0,0 +1,126 @@
+#ifndef TESTAPP_SNAPSHOT_WRITER_H
+#define TESTAPP_SNAPSHOT_WRITER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Saves the frames behind accepted snapshots as image files off the camera
+// thread. submit() copies the frame into a free slot of a small fixed ring
+// and returns; slots change hands through atomic state transitions only, so
+// the camera thread never waits on the writer or the disk. A background
+// thread downscales, encodes and writes the slots oldest first. When every
+// slot is taken the drop policy decides between discarding the new frame and
+// replacing the oldest one still waiting.
+//
+// With frame-parallel detection a snapshot is accepted a frame or two after
+// the one it was detected in; the detector keeps a copy of that frame and it
+// is the one saved, so the image matches the corners.
+class SnapshotWriter {
+
+public:
+    enum class DropPolicy {
+        Newest,
+        Oldest
+    };
+
+    struct Options {
+        int capacity;           // frames waiting to be written
+        DropPolicy drop;
+        int jpeg_quality;
+        double scale;           // downscale before encoding, 1 keeps the size
+        std::string extension;  // ".jpg" or ".png"
+
+        Options():
+                capacity(4),
+                drop(DropPolicy::Newest),
+                jpeg_quality(90),
+                scale(1.0),
+                extension(".jpg")
+                {};
+    };
+
+    struct Stats {
+        uint64_t written;
+        uint64_t dropped;
+        uint64_t failed;
+        int queue_depth;
+        int max_queue_depth;
+        double mean_write_ms;   // submit to file written
+        double max_write_ms;
+
+        std::array<double, 7> to_array() const;
+    };
+
+    SnapshotWriter();
+    // Writes what is still queued.
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    bool start(const std::string& directory, const Options& options = Options());
+    void stop();
+    bool enabled() const {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    // `frame` is the preview's RGBA image; it is saved as <directory>/snapshot_<index><extension>.
+    // Returns false when the frame was dropped. Expects a single producer thread.
+    bool submit(const cv::Mat& frame, int index);
+
+    Stats stats() const;
+
+private:
+    enum SlotState {
+        Free,
+        Filling,
+        Ready,
+        Writing
+    };
+
+    struct Slot {
+        std::atomic<int> state;
+        std::atomic<uint64_t> sequence;
+        int index;
+        std::chrono::steady_clock::time_point submitted;
+        cv::Mat image;
+    };
+
+    Slot* claim_slot();
+    Slot* next_ready();
+    int queue_depth() const;
+    bool has_ready() const;
+    void writer_loop();
+    void write(Slot& slot);
+
+    std::atomic<bool> active;
+    std::atomic<int> producers;
+    Options options;
+    std::string directory;
+    std::unique_ptr<Slot[]> slots;
+    int slot_count;
+    uint64_t next_sequence;
+
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> failed;
+    std::atomic<int> max_depth;
+    mutable std::mutex stats_mutex;
+    double total_write_ms;
+    double max_write_ms;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stopping;
+    std::thread writer;
+};
+
+#endif //TESTAPP_SNAPSHOT_WRITER_H
@@ -0,0 +1,297 @@
+#include "sparse_calibration_solver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/calib3d.hpp>
+
+#include "thread_pool.h"
+
+namespace {
+
+const int intrinsic_count = 9;
+const int pose_count = 6;
+
+typedef cv::Matx<double, intrinsic_count, 1> IntrinsicVec;
+typedef cv::Matx<double, pose_count, 1> PoseVec;
+typedef cv::Matx<double, intrinsic_count, intrinsic_count> IntrinsicBlock;
+typedef cv::Matx<double, intrinsic_count, pose_count> CrossBlock;
+typedef cv::Matx<double, pose_count, pose_count> PoseBlock;
+
+// fx, fy, cx, cy, k1, k2, p1, p2, k3
+struct Intrinsics {
+    double values[intrinsic_count];
+};
+
+struct Pose {
+    cv::Matx33d rotation;
+    cv::Vec3d translation;
+};
+
+struct ViewBlock {
+    IntrinsicBlock u;
+    CrossBlock w;
+    PoseBlock v;
+    IntrinsicVec g_a;
+    PoseVec g_b;
+    double cost;
+};
+
+// Projects one board point and, when jacobians are requested, fills the
+// derivatives of (u, v) with respect to the intrinsics and to a left
+// rotation increment followed by the translation.
+void project(const Intrinsics& k, const Pose& pose, const cv::Point3f& point, cv::Vec2d& uv,
+             cv::Matx<double, 2, intrinsic_count>* j_a, cv::Matx<double, 2, pose_count>* j_b) {
+    const double fx = k.values[0], fy = k.values[1], cx = k.values[2], cy = k.values[3];
+    const double k1 = k.values[4], k2 = k.values[5], p1 = k.values[6], p2 = k.values[7], k3 = k.values[8];
+
+    cv::Vec3d rotated = pose.rotation * cv::Vec3d(point.x, point.y, point.z);
+    cv::Vec3d camera = rotated + pose.translation;
+    double inv_z = 1.0 / camera[2];
+    double x = camera[0] * inv_z, y = camera[1] * inv_z;
+    double r2 = x * x + y * y;
+    double radial = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
+    double xd = x * radial + 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+    double yd = y * radial + p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+    uv = cv::Vec2d(fx * xd + cx, fy * yd + cy);
+
+    if (!j_a)
+        return;
+
+    double r4 = r2 * r2;
+    const double d_intrinsics[2 * intrinsic_count] = {
+            xd, 0, 1, 0, fx * x * r2, fx * x * r4, fx * 2 * x * y, fx * (r2 + 2 * x * x), fx * x * r4 * r2,
+            0, yd, 0, 1, fy * y * r2, fy * y * r4, fy * (r2 + 2 * y * y), fy * 2 * x * y, fy * y * r4 * r2};
+    *j_a = cv::Matx<double, 2, intrinsic_count>(d_intrinsics);
+
+    double d_radial = k1 + 2 * k2 * r2 + 3 * k3 * r4;
+    double dxd_dx = radial + 2 * x * x * d_radial + 2 * p1 * y + 6 * p2 * x;
+    double dxd_dy = 2 * x * y * d_radial + 2 * p1 * x + 2 * p2 * y;
+    double dyd_dx = 2 * x * y * d_radial + 2 * p1 * x + 2 * p2 * y;
+    double dyd_dy = radial + 2 * y * y * d_radial + 6 * p1 * y + 2 * p2 * x;
+
+    cv::Matx22d d_pixel_d_norm(fx * dxd_dx, fx * dxd_dy, fy * dyd_dx, fy * dyd_dy);
+    cv::Matx23d d_norm_d_camera(inv_z, 0, -x * inv_z,
+                                0, inv_z, -y * inv_z);
+    cv::Matx23d d_pixel_d_camera = d_pixel_d_norm * d_norm_d_camera;
+
+    // d(exp([w]) R X)/dw at w = 0 is -[R X]x.
+    cv::Matx33d d_camera_d_rotation(0, rotated[2], -rotated[1],
+                                    -rotated[2], 0, rotated[0],
+                                    rotated[1], -rotated[0], 0);
+    cv::Matx23d d_pixel_d_rotation = d_pixel_d_camera * d_camera_d_rotation;
+    for (int row = 0; row < 2; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            (*j_b)(row, col) = d_pixel_d_rotation(row, col);
+            (*j_b)(row, col + 3) = d_pixel_d_camera(row, col);
+        }
+    }
+}
+
+double view_cost(const Intrinsics& k, const Pose& pose, const std::vector<cv::Point3f>& board,
+                 const std::vector<cv::Point2f>& observed) {
+    double cost = 0;
+    cv::Vec2d uv;
+    for (size_t i = 0; i < board.size(); ++i) {
+        project(k, pose, board[i], uv, nullptr, nullptr);
+        double du = uv[0] - observed[i].x, dv = uv[1] - observed[i].y;
+        cost += du * du + dv * dv;
+    }
+    return cost;
+}
+
+void view_block(const Intrinsics& k, const Pose& pose, const std::vector<cv::Point3f>& board,
+                const std::vector<cv::Point2f>& observed, ViewBlock& block) {
+    block.u = IntrinsicBlock::zeros();
+    block.w = CrossBlock::zeros();
+    block.v = PoseBlock::zeros();
+    block.g_a = IntrinsicVec::zeros();
+    block.g_b = PoseVec::zeros();
+    block.cost = 0;
+
+    cv::Vec2d uv;
+    cv::Matx<double, 2, intrinsic_count> j_a;
+    cv::Matx<double, 2, pose_count> j_b;
+    for (size_t i = 0; i < board.size(); ++i) {
+        project(k, pose, board[i], uv, &j_a, &j_b);
+        cv::Matx21d residual(uv[0] - observed[i].x, uv[1] - observed[i].y);
+        block.u += j_a.t() * j_a;
+        block.w += j_a.t() * j_b;
+        block.v += j_b.t() * j_b;
+        block.g_a += j_a.t() * residual;
+        block.g_b += j_b.t() * residual;
+        block.cost += residual.dot(residual);
+    }
+}
+
+template <int n>
+cv::Matx<double, n, n> damped(const cv::Matx<double, n, n>& block, double lambda) {
+    cv::Matx<double, n, n> result = block;
+    for (int i = 0; i < n; ++i)
+        result(i, i) += lambda * std::max(block(i, i), 1e-12);
+    return result;
+}
+
+Pose apply_step(const Pose& pose, const PoseVec& step) {
+    cv::Matx33d increment;
+    cv::Rodrigues(cv::Vec3d(step(0), step(1), step(2)), increment);
+    Pose updated;
+    updated.rotation = increment * pose.rotation;
+    updated.translation = pose.translation + cv::Vec3d(step(3), step(4), step(5));
+    return updated;
+}
+
+Intrinsics to_intrinsics(const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs) {
+    cv::Mat matrix;
+    camera_matrix.convertTo(matrix, CV_64F);
+    Intrinsics k = {{matrix.at<double>(0, 0), matrix.at<double>(1, 1),
+                     matrix.at<double>(0, 2), matrix.at<double>(1, 2), 0, 0, 0, 0, 0}};
+    if (!dist_coeffs.empty()) {
+        cv::Mat dist;
+        dist_coeffs.reshape(1, static_cast<int>(dist_coeffs.total())).convertTo(dist, CV_64F);
+        const int order[] = {4, 5, 6, 7, 8};
+        for (int i = 0; i < std::min(5, dist.rows); ++i)
+            k.values[order[i]] = dist.at<double>(i);
+    }
+    return k;
+}
+
+}
+
+SparseCalibrationSolver::SparseCalibrationSolver(const Options& options):
+        options(options) {
+}
+
+SparseCalibrationResult SparseCalibrationSolver::solve(const std::vector<cv::Point3f>& board,
+                                                       const std::vector<std::vector<cv::Point2f> >& views,
+                                                       const cv::Size& image_size) const {
+    std::vector<std::vector<cv::Point3f> > object_points(views.size(), board);
+    cv::Mat camera_matrix = cv::initCameraMatrix2D(object_points, views, image_size);
+    return solve(board, views, camera_matrix, cv::Mat());
+}
+
+SparseCalibrationResult SparseCalibrationSolver::solve(const std::vector<cv::Point3f>& board,
+                                                       const std::vector<std::vector<cv::Point2f> >& views,
+                                                       const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs) const {
+    for (const std::vector<cv::Point2f>& view : views)
+        CV_Assert(view.size() == board.size());
+    CV_Assert(!views.empty() && board.size() >= 4);
+
+    Intrinsics k = to_intrinsics(camera_matrix, dist_coeffs);
+    std::vector<Pose> poses(views.size());
+    std::vector<ViewBlock> blocks(views.size());
+    std::shared_ptr<ThreadPool> pool = ThreadPool::shared();
+    auto for_each_view = [&](std::function<void(const cv::Range&)> body) {
+        cv::Range all(0, static_cast<int>(views.size()));
+        if (options.parallel)
+            pool->parallel_for_(Lane::Background, all, body);
+        else
+            body(all);
+    };
+
+    for_each_view([&](const cv::Range& range) {
+        cv::Mat dist = dist_coeffs.empty() ? cv::Mat() : dist_coeffs;
+        for (int i = range.start; i < range.end; ++i) {
+            cv::Vec3d r_vec, t_vec;
+            cv::solvePnP(board, views[i], camera_matrix, dist, r_vec, t_vec, false, cv::SOLVEPNP_IPPE);
+            cv::Rodrigues(r_vec, poses[i].rotation);
+            poses[i].translation = t_vec;
+        }
+    });
+
+    auto evaluate_blocks = [&]() {
+        for_each_view([&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i)
+                view_block(k, poses[i], board, views[i], blocks[i]);
+        });
+        double cost = 0;
+        for (const ViewBlock& block : blocks)
+            cost += block.cost;
+        return cost;
+    };
+
+    double cost = evaluate_blocks();
+    double lambda = 1e-3;
+    const double max_lambda = 1e10;
+    int iteration = 0;
+    bool converged = false;
+    std::vector<Pose> candidate_poses(views.size());
+    std::vector<PoseBlock> v_inverse(views.size());
+    std::vector<PoseVec> pose_steps(views.size());
+    std::vector<double> candidate_costs(views.size());
+
+    while (iteration < options.max_iterations && !converged) {
+        IntrinsicBlock u = IntrinsicBlock::zeros();
+        IntrinsicVec g_a = IntrinsicVec::zeros();
+        for (const ViewBlock& block : blocks) {
+            u += block.u;
+            g_a += block.g_a;
+        }
+
+        bool improved = false;
+        while (!improved && !converged) {
+            if (lambda > max_lambda) {
+                converged = true;
+                break;
+            }
+            // Reduced system S da = rhs with S = U - sum W V^-1 W^T and
+            // rhs = -g_a + sum W V^-1 g_b; each pose step follows from da.
+            IntrinsicBlock schur = damped(u, lambda);
+            IntrinsicVec rhs = -g_a;
+            for (size_t i = 0; i < views.size(); ++i) {
+                v_inverse[i] = damped(blocks[i].v, lambda).inv(cv::DECOMP_CHOLESKY);
+                CrossBlock w_v_inverse = blocks[i].w * v_inverse[i];
+                schur -= w_v_inverse * blocks[i].w.t();
+                rhs += w_v_inverse * blocks[i].g_b;
+            }
+            IntrinsicVec intrinsic_step = schur.solve(rhs, cv::DECOMP_CHOLESKY);
+
+            Intrinsics candidate = k;
+            for (int j = 0; j < intrinsic_count; ++j)
+                candidate.values[j] += intrinsic_step(j);
+            for (size_t i = 0; i < views.size(); ++i)
+                pose_steps[i] = v_inverse[i] * (-blocks[i].g_b - blocks[i].w.t() * intrinsic_step);
+
+            for_each_view([&](const cv::Range& range) {
+                for (int i = range.start; i < range.end; ++i) {
+                    candidate_poses[i] = apply_step(poses[i], pose_steps[i]);
+                    candidate_costs[i] = view_cost(candidate, candidate_poses[i], board, views[i]);
+                }
+            });
+            double candidate_cost = 0;
+            for (double view : candidate_costs)
+                candidate_cost += view;
+
+            if (std::isfinite(candidate_cost) && candidate_cost < cost) {
+                converged = (cost - candidate_cost) <= options.epsilon * cost;
+                k = candidate;
+                poses.swap(candidate_poses);
+                cost = evaluate_blocks();
+                lambda = std::max(lambda / 10, 1e-12);
+                improved = true;
+            } else {
+                lambda *= 10;
+            }
+        }
+        ++iteration;
+    }
+
+    SparseCalibrationResult result;
+    result.camera_matrix = (cv::Mat_<double>(3, 3) <<
+            k.values[0], 0, k.values[2],
+            0, k.values[1], k.values[3],
+            0, 0, 1);
+    result.dist_coeffs = (cv::Mat_<double>(8, 1) <<
+            k.values[4], k.values[5], k.values[6], k.values[7], k.values[8], 0, 0, 0);
+    result.iterations = iteration;
+    size_t points = 0;
+    for (size_t i = 0; i < views.size(); ++i) {
+        cv::Vec3d r_vec;
+        cv::Rodrigues(poses[i].rotation, r_vec);
+        result.r_vecs.push_back(r_vec);
+        result.t_vecs.push_back(poses[i].translation);
+        result.per_view_errors.push_back(std::sqrt(blocks[i].cost / board.size()));
+        points += board.size();
+    }
+    result.rms = std::sqrt(cost / points);
+    return result;
+}
@@ -0,0 +1,58 @@
+#ifndef TESTAPP_SPARSE_CALIBRATION_SOLVER_H
+#define TESTAPP_SPARSE_CALIBRATION_SOLVER_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+struct SparseCalibrationResult {
+    cv::Mat camera_matrix;
+    cv::Mat dist_coeffs;
+    std::vector<cv::Vec3d> r_vecs;
+    std::vector<cv::Vec3d> t_vecs;
+    std::vector<double> per_view_errors;
+    double rms;
+    int iterations;
+};
+
+// Levenberg-Marquardt over the pinhole model with k1, k2, p1, p2, k3 that
+// exploits the block structure of calibration: each view only couples its own
+// six pose parameters with the nine shared intrinsics. The per-view blocks are
+// eliminated with a Schur complement, leaving a 9x9 system per iteration, so
+// the cost grows linearly with the number of views instead of cubically as in
+// cv::calibrateCamera's dense normal matrix. Jacobians are analytic; poses are
+// updated multiplicatively on SO(3).
+class SparseCalibrationSolver {
+
+public:
+    struct Options {
+        int max_iterations;
+        double epsilon;
+        bool parallel;      // spread per-view work over the background lane
+
+        Options():
+                max_iterations(50),
+                epsilon(1e-12),
+                parallel(true)
+                {};
+    };
+
+    explicit SparseCalibrationSolver(const Options& options = Options());
+
+    // Every view must contain every board corner; throws cv::Exception
+    // otherwise. The result's dist_coeffs is 8x1 to match calibrateCamera;
+    // k4..k6 stay zero.
+    SparseCalibrationResult solve(const std::vector<cv::Point3f>& board,
+                                  const std::vector<std::vector<cv::Point2f> >& views,
+                                  const cv::Size& image_size) const;
+
+    // Same solve warm-started from a previous result, e.g. when views are
+    // added or resampled; the poses are re-estimated, the intrinsics reused.
+    SparseCalibrationResult solve(const std::vector<cv::Point3f>& board,
+                                  const std::vector<std::vector<cv::Point2f> >& views,
+                                  const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs) const;
+
+private:
+    Options options;
+};
+
+#endif //TESTAPP_SPARSE_CALIBRATION_SOLVER_H
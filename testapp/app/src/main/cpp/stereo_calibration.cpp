@@ -0,0 +1,192 @@
+#include "stereo_calibration.h"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "corner_refinement.h"
+#include "thread_pool.h"
+#include "trace_recorder.h"
+
+bool StereoResult::save(const std::string& path) const {
+    cv::FileStorage storage(path, cv::FileStorage::WRITE);
+    if (!storage.isOpened())
+        return false;
+    storage << "camera_matrix_1" << camera_matrix[0] << "dist_coeffs_1" << dist_coeffs[0];
+    storage << "camera_matrix_2" << camera_matrix[1] << "dist_coeffs_2" << dist_coeffs[1];
+    storage << "R" << r << "T" << t << "E" << e << "F" << f;
+    storage << "R1" << rectification[0] << "R2" << rectification[1];
+    storage << "P1" << projection[0] << "P2" << projection[1] << "Q" << q;
+    storage << "valid_roi_1" << valid_roi[0] << "valid_roi_2" << valid_roi[1];
+    storage << "image_size" << image_size << "rms" << rms;
+    return true;
+}
+
+bool StereoResult::load(const std::string& path, StereoResult& result) {
+    cv::FileStorage storage(path, cv::FileStorage::READ);
+    if (!storage.isOpened())
+        return false;
+    StereoResult loaded;
+    storage["camera_matrix_1"] >> loaded.camera_matrix[0];
+    storage["dist_coeffs_1"] >> loaded.dist_coeffs[0];
+    storage["camera_matrix_2"] >> loaded.camera_matrix[1];
+    storage["dist_coeffs_2"] >> loaded.dist_coeffs[1];
+    storage["R"] >> loaded.r;
+    storage["T"] >> loaded.t;
+    storage["E"] >> loaded.e;
+    storage["F"] >> loaded.f;
+    storage["R1"] >> loaded.rectification[0];
+    storage["R2"] >> loaded.rectification[1];
+    storage["P1"] >> loaded.projection[0];
+    storage["P2"] >> loaded.projection[1];
+    storage["Q"] >> loaded.q;
+    storage["valid_roi_1"] >> loaded.valid_roi[0];
+    storage["valid_roi_2"] >> loaded.valid_roi[1];
+    storage["image_size"] >> loaded.image_size;
+    storage["rms"] >> loaded.rms;
+    if (loaded.image_size.area() <= 0)
+        return false;
+    for (int i = 0; i < 2; ++i)
+        if (loaded.camera_matrix[i].size() != cv::Size(3, 3) || loaded.dist_coeffs[i].empty()
+            || loaded.rectification[i].size() != cv::Size(3, 3) || loaded.projection[i].size() != cv::Size(4, 3))
+            return false;
+    result = loaded;
+    return true;
+}
+
+StereoCalibration::StereoCalibration():
+        square_size(0),
+        detection(DetectionConfig::defaults()) {
+    solution.rms = 0;
+}
+
+void StereoCalibration::set_sizes(const cv::Size& board, const cv::Size& image, int square) {
+    board_size = board;
+    image_size = image;
+    square_size = square;
+    clear();
+}
+
+void StereoCalibration::set_detection_config(const DetectionConfig& config) {
+    detection = config;
+}
+
+bool StereoCalibration::detect(const cv::Mat& frame, std::vector<cv::Point2f>& found, cv::Mat& gray_frame) const {
+    if (frame.channels() == 1)
+        gray_frame = frame;
+    else
+        cv::cvtColor(frame, gray_frame, frame.channels() == 4 ? cv::COLOR_RGBA2GRAY : cv::COLOR_BGR2GRAY);
+    cv::Mat level = gray_frame;
+    for (int i = 0; i < detection.pyramid_level; ++i)
+        cv::pyrDown(level, level);
+    if (!cv::findChessboardCorners(level, board_size, found, detection.flags))
+        return false;
+    float scale = static_cast<float>(1 << detection.pyramid_level);
+    for (cv::Point2f& corner : found)
+        corner *= scale;
+    // Every pair is a calibration view, so always full precision.
+    CornerRefiner::Options options;
+    options.max_window = detection.subpix_window;
+    options.max_iterations = detection.subpix_iterations;
+    options.epsilon = detection.subpix_epsilon;
+    CornerRefiner(options).refine(gray_frame, board_size, found);
+    return true;
+}
+
+int StereoCalibration::add_pair(const cv::Mat& first, const cv::Mat& second) {
+    if (first.size() != image_size || second.size() != image_size)
+        return static_cast<int>(pairs());
+    TraceSpan span("stereo_detect");
+    const cv::Mat* views[] = {&first, &second};
+    bool found[2];
+    ThreadPool::shared()->parallel_for_(Lane::Latency, cv::Range(0, 2), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i)
+            found[i] = detect(*views[i], corners[i], gray[i]);
+    }, 2);
+    if (found[0] && found[1])
+        for (int i = 0; i < 2; ++i)
+            image_points[i].push_back(corners[i]);
+    return static_cast<int>(pairs());
+}
+
+size_t StereoCalibration::pairs() const {
+    return image_points[0].size();
+}
+
+void StereoCalibration::clear() {
+    for (int i = 0; i < 2; ++i)
+        image_points[i].clear();
+}
+
+const StereoResult& StereoCalibration::calibrate(double alpha) {
+    TraceSpan span("stereo_calibrate");
+    CV_Assert(pairs() >= 4);
+    std::vector<cv::Point3f> board;
+    for (int i = 0; i < board_size.height; ++i)
+        for (int j = 0; j < board_size.width; ++j)
+            board.emplace_back(static_cast<float>(j * square_size), static_cast<float>(i * square_size), 0.f);
+    std::vector<std::vector<cv::Point3f> > object_points(pairs(), board);
+
+    // Each camera alone first: stereoCalibrate converges poorly from a
+    // default guess, and the two solves are independent.
+    StereoResult next;
+    next.image_size = image_size;
+    ThreadPool::shared()->parallel_for_(Lane::Latency, cv::Range(0, 2), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            std::vector<cv::Mat> rvecs, tvecs;
+            cv::calibrateCamera(object_points, image_points[i], image_size, next.camera_matrix[i],
+                                next.dist_coeffs[i], rvecs, tvecs);
+        }
+    }, 2);
+
+    next.rms = cv::stereoCalibrate(object_points, image_points[0], image_points[1],
+                                   next.camera_matrix[0], next.dist_coeffs[0],
+                                   next.camera_matrix[1], next.dist_coeffs[1], image_size,
+                                   next.r, next.t, next.e, next.f, cv::CALIB_USE_INTRINSIC_GUESS,
+                                   cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, 1e-6));
+    cv::stereoRectify(next.camera_matrix[0], next.dist_coeffs[0], next.camera_matrix[1], next.dist_coeffs[1],
+                      image_size, next.r, next.t, next.rectification[0], next.rectification[1],
+                      next.projection[0], next.projection[1], next.q, cv::CALIB_ZERO_DISPARITY, alpha,
+                      image_size, &next.valid_roi[0], &next.valid_roi[1]);
+    solution = next;
+    build_maps();
+    return solution;
+}
+
+void StereoCalibration::set_result(const StereoResult& result) {
+    solution = result;
+    build_maps();
+}
+
+const StereoResult& StereoCalibration::result() const {
+    return solution;
+}
+
+void StereoCalibration::build_maps() {
+    ThreadPool::shared()->parallel_for_(Lane::Latency, cv::Range(0, 2), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i)
+            cv::initUndistortRectifyMap(solution.camera_matrix[i], solution.dist_coeffs[i], solution.rectification[i],
+                                        solution.projection[i], solution.image_size, CV_16SC2, map1[i], map2[i]);
+    }, 2);
+}
+
+bool StereoCalibration::rectify(const cv::Mat& first, const cv::Mat& second, cv::Mat& first_out,
+                                cv::Mat& second_out) const {
+    if (map1[0].empty() || first.size() != map1[0].size() || second.size() != map1[1].size())
+        return false;
+    TraceSpan span("stereo_rectify");
+    first_out.create(first.size(), first.type());
+    second_out.create(second.size(), second.type());
+    const cv::Mat* sources[] = {&first, &second};
+    cv::Mat* targets[] = {&first_out, &second_out};
+    int rows = first.rows;
+    // Rows of both views in one range, so the stripes balance across the pair.
+    ThreadPool::shared()->parallel_for_(Lane::Latency, cv::Range(0, 2 * rows), [&](const cv::Range& range) {
+        for (int view = range.start / rows; view <= (range.end - 1) / rows; ++view) {
+            cv::Range view_rows(std::max(range.start - view * rows, 0), std::min(range.end - view * rows, rows));
+            cv::Mat target_rows = targets[view]->rowRange(view_rows);
+            cv::remap(*sources[view], target_rows, map1[view].rowRange(view_rows), map2[view].rowRange(view_rows),
+                      cv::INTER_LINEAR);
+        }
+    });
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef TESTAPP_STEREO_CALIBRATION_H
+#define TESTAPP_STEREO_CALIBRATION_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "detection_tuning.h"
+
+struct StereoResult {
+    std::array<cv::Mat, 2> camera_matrix;
+    std::array<cv::Mat, 2> dist_coeffs;
+    cv::Mat r;              // rotation and translation from the first camera to the second
+    cv::Mat t;
+    cv::Mat e;
+    cv::Mat f;
+    std::array<cv::Mat, 2> rectification;
+    std::array<cv::Mat, 2> projection;
+    cv::Mat q;              // disparity-to-depth
+    std::array<cv::Rect, 2> valid_roi;
+    cv::Size image_size;
+    double rms;
+
+    bool save(const std::string& path) const;
+    static bool load(const std::string& path, StereoResult& result);
+};
+
+// Two-camera calibration from synchronized frame pairs. A pair is kept only
+// when the board is found in both views; the views are detected in parallel.
+// calibrate() solves each camera alone for a starting point, then runs
+// stereoCalibrate and stereoRectify and builds both rectification maps once,
+// in the fixed-point CV_16SC2 format. rectify() then costs one remap per
+// view, with the rows of both views striped over the latency lane together.
+class StereoCalibration {
+
+public:
+    StereoCalibration();
+
+    void set_sizes(const cv::Size& board, const cv::Size& image, int square);
+    void set_detection_config(const DetectionConfig& config);
+    // Frames may be gray or RGBA/BGR. Returns the number of pairs kept.
+    int add_pair(const cv::Mat& first, const cv::Mat& second);
+    size_t pairs() const;
+    void clear();
+
+    // Needs at least 4 pairs; throws cv::Exception on degenerate views.
+    // `alpha` is stereoRectify's free scaling: 0 keeps only valid pixels,
+    // 1 keeps every source pixel.
+    const StereoResult& calibrate(double alpha = 0);
+    // Adopts a saved result and rebuilds the maps for it.
+    void set_result(const StereoResult& result);
+    const StereoResult& result() const;
+
+    // One remap per view into the rectified frames. The outputs must not
+    // alias the inputs; false until a result is set or for frames of another size.
+    bool rectify(const cv::Mat& first, const cv::Mat& second, cv::Mat& first_out, cv::Mat& second_out) const;
+
+private:
+    bool detect(const cv::Mat& frame, std::vector<cv::Point2f>& found, cv::Mat& gray_frame) const;
+    void build_maps();
+
+    cv::Size board_size;
+    cv::Size image_size;
+    int square_size;
+    DetectionConfig detection;
+    std::array<std::vector<std::vector<cv::Point2f> >, 2> image_points;
+    // Per-view scratch, reused across pairs.
+    std::array<cv::Mat, 2> gray;
+    std::array<std::vector<cv::Point2f>, 2> corners;
+
+    StereoResult solution;
+    std::array<cv::Mat, 2> map1;
+    std::array<cv::Mat, 2> map2;
+};
+
+#endif //TESTAPP_STEREO_CALIBRATION_H
@@ -0,0 +1,61 @@
+// Steady-state allocation check for the per-frame paths: once identify_chessboard
+// and undistort_image have seen a frame sequence, running it again must be
+// served entirely from the session's FrameArena pools.
+//
+// The shared pool runs without workers and OpenCV's own threads are off, so
+// every allocation happens on the calling thread in the same order each pass.
+
+#include <cstdio>
+
+#include "camera_calibration.h"
+#include "synthetic_views.h"
+
+int main() {
+    ThreadPool::Config config = ThreadPool::Config::defaults();
+    config.latency_workers = 0;
+    config.background_workers = 0;
+    config.pin_threads = false;
+    ThreadPool::configure_shared(config);
+    cv::setNumThreads(0);
+
+    const cv::Size image_size(640, 480);
+    const cv::Size board_size(9, 6);
+    const int square_size = 25;
+    SyntheticCamera camera = SyntheticCamera::typical(image_size);
+    std::vector<SyntheticView> views = render_views(camera, board_size, square_size, 8);
+
+    CameraCalibration calibration;
+    calibration.set_sizes(board_size, image_size, square_size);
+    calibration.set_adaptive_quality(false);
+
+    cv::Mat frame;
+    auto run_pass = [&] {
+        for (const SyntheticView& view : views) {
+            view.frame.copyTo(frame);
+            calibration.identify_chessboard(frame, false);
+            view.frame.copyTo(frame);
+            calibration.undistort_image(frame, camera.camera_matrix, camera.dist_coeffs);
+        }
+    };
+
+    for (int pass = 0; pass < 2; ++pass)
+        run_pass();
+    calibration.reset_stats();
+    const int passes = 4;
+    for (int pass = 0; pass < passes; ++pass)
+        run_pass();
+
+    FrameArena::Stats stats = calibration.allocation_stats();
+    printf("%d frames: %zu heap allocations, %zu pool hits\n", passes * static_cast<int>(views.size()),
+           stats.heap_allocations, stats.pool_hits);
+    if (stats.heap_allocations != 0) {
+        fprintf(stderr, "FAIL: steady state allocated %zu times (%zu bytes)\n", stats.heap_allocations,
+                stats.heap_bytes);
+        return 1;
+    }
+    if (stats.pool_hits == 0) {
+        fprintf(stderr, "FAIL: no allocation went through the arena\n");
+        return 1;
+    }
+    return 0;
+}
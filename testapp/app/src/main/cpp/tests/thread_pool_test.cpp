@@ -0,0 +1,119 @@
+// Lane sizing and core pinning of ThreadPool, checked through sched_getaffinity
+// from inside the workers. A fake big.LITTLE split of the CPUs this process
+// may use stands in for the topology; with a single CPU both lanes share it.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+// Affinity and thread id seen by `tasks` tasks submitted to `lane`; each task
+// waits for the others so every worker of the lane takes one.
+void run_lane(ThreadPool& pool, Lane lane, int tasks, std::set<std::vector<int> >& affinities,
+              std::set<std::thread::id>& threads) {
+    std::mutex mutex;
+    std::atomic<int> started(0);
+    std::vector<std::future<void> > results;
+    for (int i = 0; i < tasks; ++i)
+        results.push_back(pool.submit(lane, [&] {
+            ++started;
+            while (started.load() < tasks)
+                std::this_thread::yield();
+            std::lock_guard<std::mutex> lock(mutex);
+            affinities.insert(thread_affinity());
+            threads.insert(std::this_thread::get_id());
+        }));
+    for (std::future<void>& result : results)
+        result.get();
+}
+
+}
+
+int main() {
+    std::vector<int> cpus = thread_affinity();
+    check(!cpus.empty(), "sched_getaffinity lists the allowed CPUs");
+    if (cpus.empty())
+        return 1;
+
+    ThreadPool::Config config;
+    config.topology.big_cores = {cpus.back()};
+    config.topology.little_cores = {cpus.front()};
+    config.latency_workers = 2;
+    config.background_workers = 3;
+    config.pin_threads = true;
+    {
+        ThreadPool pool(config);
+        check(pool.workers(Lane::Latency) == 2, "latency lane has 2 workers");
+        check(pool.workers(Lane::Background) == 3, "background lane has 3 workers");
+
+        std::set<std::vector<int> > affinities;
+        std::set<std::thread::id> threads;
+        run_lane(pool, Lane::Latency, 2, affinities, threads);
+        check(threads.size() == 2, "latency tasks ran on 2 worker threads");
+        check(affinities == std::set<std::vector<int> >{config.topology.big_cores},
+              "latency workers are pinned to the big cores");
+
+        affinities.clear();
+        threads.clear();
+        run_lane(pool, Lane::Background, 3, affinities, threads);
+        check(threads.size() == 3, "background tasks ran on 3 worker threads");
+        check(affinities == std::set<std::vector<int> >{config.topology.little_cores},
+              "background workers are pinned to the little cores");
+
+        // Every stripe runs once, spread over the caller and the latency workers.
+        std::vector<std::atomic<int> > hits(1000);
+        std::mutex mutex;
+        std::set<std::thread::id> stripe_threads;
+        pool.parallel_for_(Lane::Latency, cv::Range(0, 1000), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i)
+                ++hits[i];
+            std::lock_guard<std::mutex> lock(mutex);
+            stripe_threads.insert(std::this_thread::get_id());
+        });
+        check(std::all_of(hits.begin(), hits.end(), [](const std::atomic<int>& hit) { return hit.load() == 1; }),
+              "parallel_for_ covers the range exactly once");
+        check(stripe_threads.size() <= 3, "parallel_for_ stays on the caller and the latency lane");
+    }
+
+    // Without background workers, background tasks fall back to the latency lane.
+    config.background_workers = 0;
+    {
+        ThreadPool pool(config);
+        check(pool.workers(Lane::Background) == 2, "background lane borrows the latency workers");
+        std::set<std::vector<int> > affinities;
+        std::set<std::thread::id> threads;
+        run_lane(pool, Lane::Background, 2, affinities, threads);
+        check(affinities == std::set<std::vector<int> >{config.topology.big_cores},
+              "borrowed background tasks run on the big cores");
+    }
+
+    // Unpinned workers keep the process's affinity.
+    config.pin_threads = false;
+    {
+        ThreadPool pool(config);
+        std::set<std::vector<int> > affinities;
+        std::set<std::thread::id> threads;
+        run_lane(pool, Lane::Latency, 2, affinities, threads);
+        check(affinities == std::set<std::vector<int> >{cpus}, "unpinned workers keep every allowed CPU");
+    }
+
+    if (!failures)
+        printf("thread pool lanes and pinning as configured\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <exception>
+#include <sched.h>
+
+namespace {
+
+std::mutex shared_mutex;
+std::shared_ptr<ThreadPool> shared_pool;
+
+long read_cpu_value(int cpu, const char* file) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, file);
+    FILE* input = fopen(path, "r");
+    if (!input)
+        return -1;
+    long value = -1;
+    if (fscanf(input, "%ld", &value) != 1)
+        value = -1;
+    fclose(input);
+    return value;
+}
+
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus = thread_affinity();
+    if (cpus.empty()) {
+        int count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int cpu = 0; cpu < count; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+int lane_index(Lane lane) {
+    return lane == Lane::Latency ? 0 : 1;
+}
+
+struct StripeState {
+    std::atomic<int> next_stripe;
+    std::atomic<int> pending;
+    int stripes;
+    cv::Range range;
+    const cv::ParallelLoopBody* body;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+
+    cv::Range stripe(int index) const {
+        int length = range.end - range.start;
+        return cv::Range(range.start + static_cast<int>(static_cast<long long>(length) * index / stripes),
+                         range.start + static_cast<int>(static_cast<long long>(length) * (index + 1) / stripes));
+    }
+
+    // Runs stripes until none are left. The body is only touched after a
+    // stripe is claimed, so helpers that start late never see a dead body.
+    void drain() {
+        int index;
+        while ((index = next_stripe.fetch_add(1)) < stripes) {
+            try {
+                (*body)(stripe(index));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+            if (pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+};
+
+}
+
+CpuTopology CpuTopology::detect() {
+    std::vector<int> cpus = allowed_cpus();
+    std::vector<long> values;
+    const char* sources[] = {"cpu_capacity", "cpufreq/cpuinfo_max_freq"};
+    for (const char* source : sources) {
+        values.clear();
+        for (int cpu : cpus) {
+            long value = read_cpu_value(cpu, source);
+            if (value <= 0)
+                break;
+            values.push_back(value);
+        }
+        if (values.size() == cpus.size())
+            break;
+    }
+
+    CpuTopology topology;
+    if (values.size() != cpus.size()) {
+        topology.big_cores = cpus;
+        topology.little_cores = cpus;
+        return topology;
+    }
+    long lowest = *std::min_element(values.begin(), values.end());
+    for (size_t i = 0; i < cpus.size(); ++i)
+        (values[i] > lowest ? topology.big_cores : topology.little_cores).push_back(cpus[i]);
+    if (topology.big_cores.empty())
+        topology.big_cores = topology.little_cores;
+    return topology;
+}
+
+const std::vector<int>& CpuTopology::cores(Lane lane) const {
+    return lane == Lane::Latency ? big_cores : little_cores;
+}
+
+bool set_thread_affinity(const std::vector<int>& cpus) {
+    if (cpus.empty())
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+std::vector<int> thread_affinity() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    return cpus;
+}
+
+ThreadPool::Config ThreadPool::Config::defaults() {
+    Config config;
+    config.topology = CpuTopology::detect();
+    // The thread calling into the pipeline works on latency stripes as well.
+    config.latency_workers = std::max(1, static_cast<int>(config.topology.big_cores.size()) - 1);
+    config.background_workers = config.topology.little_cores == config.topology.big_cores
+            ? 0 : static_cast<int>(config.topology.little_cores.size());
+    config.pin_threads = true;
+    return config;
+}
+
+ThreadPool::ThreadPool(const Config& config):
+        pool_config(config),
+        stopping(false) {
+    for (int i = 0; i < std::max(0, config.latency_workers); ++i)
+        threads.emplace_back(&ThreadPool::worker_loop, this, Lane::Latency);
+    for (int i = 0; i < std::max(0, config.background_workers); ++i)
+        threads.emplace_back(&ThreadPool::worker_loop, this, Lane::Background);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready[0].notify_all();
+    ready[1].notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void ThreadPool::parallel_for_(Lane lane, const cv::Range& range, const cv::ParallelLoopBody& body,
+                               double nstripes) {
+    if (range.empty())
+        return;
+    int length = range.end - range.start;
+    int helpers = workers(lane);
+    int stripes = nstripes > 0 ? static_cast<int>(nstripes) : helpers + 1;
+    stripes = std::max(1, std::min(stripes, length));
+    if (stripes == 1 || helpers == 0) {
+        body(range);
+        return;
+    }
+
+    std::shared_ptr<StripeState> state = std::make_shared<StripeState>();
+    state->next_stripe = 0;
+    state->pending = stripes;
+    state->stripes = stripes;
+    state->range = range;
+    state->body = &body;
+    for (int i = 0; i < std::min(helpers, stripes - 1); ++i)
+        enqueue(lane, [state] { state->drain(); });
+
+    state->drain();
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&state] { return state->pending.load() == 0; });
+    }
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+void ThreadPool::parallel_for_(Lane lane, const cv::Range& range, std::function<void(const cv::Range&)> functor,
+                               double nstripes) {
+    parallel_for_(lane, range, cv::ParallelLoopBodyLambdaWrapper(functor), nstripes);
+}
+
+int ThreadPool::workers(Lane lane) const {
+    if (served_by(lane) == Lane::Latency)
+        return std::max(0, pool_config.latency_workers);
+    return std::max(0, pool_config.background_workers);
+}
+
+const ThreadPool::Config& ThreadPool::config() const {
+    return pool_config;
+}
+
+void ThreadPool::pin_current_thread(Lane lane) const {
+    if (pool_config.pin_threads)
+        set_thread_affinity(pool_config.topology.cores(lane));
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::shared() {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    if (!shared_pool) {
+        shared_pool = std::make_shared<ThreadPool>(Config::defaults());
+        cv::setNumThreads(0);
+    }
+    return shared_pool;
+}
+
+void ThreadPool::configure_shared(const Config& config) {
+    std::shared_ptr<ThreadPool> previous;
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        previous = shared_pool;
+        shared_pool = std::make_shared<ThreadPool>(config);
+        cv::setNumThreads(0);
+    }
+    // The old pool drains its queues and joins once its last user lets go of it.
+}
+
+void ThreadPool::enqueue(Lane lane, std::function<void()> task) {
+    Lane target = served_by(lane);
+    if (workers(target) == 0) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queues[lane_index(target)].push_back(std::move(task));
+    }
+    ready[lane_index(target)].notify_one();
+}
+
+void ThreadPool::worker_loop(Lane lane) {
+    pin_current_thread(lane);
+    int index = lane_index(lane);
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready[index].wait(lock, [this, index] { return stopping || !queues[index].empty(); });
+            if (queues[index].empty())
+                return;
+            task = std::move(queues[index].front());
+            queues[index].pop_front();
+        }
+        task();
+    }
+}
+
+Lane ThreadPool::served_by(Lane lane) const {
+    if (lane == Lane::Background && pool_config.background_workers <= 0)
+        return Lane::Latency;
+    if (lane == Lane::Latency && pool_config.latency_workers <= 0 && pool_config.background_workers > 0)
+        return Lane::Background;
+    return lane;
+}
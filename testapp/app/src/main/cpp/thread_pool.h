@@ -0,0 +1,93 @@
+#ifndef TESTAPP_THREAD_POOL_H
+#define TESTAPP_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+
+// Latency-critical work (detection, remap) runs on the big cores, background
+// work (solves, fitting, bootstrap) on the little ones.
+enum class Lane {
+    Latency,
+    Background
+};
+
+struct CpuTopology {
+    std::vector<int> big_cores;
+    std::vector<int> little_cores;
+
+    // Classifies the CPUs this process may run on by cpu_capacity, falling
+    // back to cpuinfo_max_freq. Cores at the lowest value are little; with a
+    // homogeneous CPU every core is in both sets.
+    static CpuTopology detect();
+    const std::vector<int>& cores(Lane lane) const;
+};
+
+bool set_thread_affinity(const std::vector<int>& cpus);
+std::vector<int> thread_affinity();
+
+// The library's only worker pool. OpenCV's own parallel backend is switched
+// off while a shared pool is configured, so striped stages go through
+// parallel_for_ below instead of competing with a second set of threads.
+class ThreadPool {
+
+public:
+    struct Config {
+        int latency_workers;
+        int background_workers;
+        bool pin_threads;
+        CpuTopology topology;
+
+        static Config defaults();
+    };
+
+    explicit ThreadPool(const Config& config);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> submit(Lane lane, F task) {
+        typedef typename std::result_of<F()>::type Result;
+        std::shared_ptr<std::packaged_task<Result()> > packaged =
+                std::make_shared<std::packaged_task<Result()> >(std::move(task));
+        std::future<Result> result = packaged->get_future();
+        enqueue(lane, [packaged] { (*packaged)(); });
+        return result;
+    }
+
+    // Same contract as cv::parallel_for_; the calling thread takes stripes
+    // too, so it is safe to call from inside a pool task.
+    void parallel_for_(Lane lane, const cv::Range& range, const cv::ParallelLoopBody& body,
+                       double nstripes = -1.);
+    void parallel_for_(Lane lane, const cv::Range& range, std::function<void(const cv::Range&)> functor,
+                       double nstripes = -1.);
+
+    int workers(Lane lane) const;
+    const Config& config() const;
+    void pin_current_thread(Lane lane) const;
+
+    static std::shared_ptr<ThreadPool> shared();
+    static void configure_shared(const Config& config);
+
+private:
+    void enqueue(Lane lane, std::function<void()> task);
+    void worker_loop(Lane lane);
+    Lane served_by(Lane lane) const;
+
+    const Config pool_config;
+    std::mutex mutex;
+    std::condition_variable ready[2];
+    std::deque<std::function<void()> > queues[2];
+    std::vector<std::thread> threads;
+    bool stopping;
+};
+
+#endif //TESTAPP_THREAD_POOL_H
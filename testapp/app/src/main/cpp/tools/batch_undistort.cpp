@@ -0,0 +1,332 @@
+// Undistorts an image folder or a video file with CameraCalibration's cached
+// remap. Decoding, remapping and encoding run as separate stages on their own
+// threads, connected by bounded queues, so disk and codec work overlaps with
+// the remap, which itself is striped over the thread pool. The undistortion
+// map is built once for the whole job.
+//
+//   calibration-undistort INPUT --calibration FILE --out PATH [--workers N]
+//                         [--queue N] [--fourcc XXXX] [--jpeg-quality N]
+//                         [--fisheye] [--balance B] [--fov-scale F]
+//
+// INPUT is a folder of .jpg/.jpeg/.png/.bmp/.tif images, written under the
+// same names into the folder PATH, or a video, re-encoded to the file PATH
+// with --fourcc (MJPG by default). FILE is a cv::FileStorage file with
+// camera_matrix and dist_coeffs, such as calibration-replay's --reference.
+// --workers sets the decode and encode threads for image folders; videos use
+// one of each to keep the frame order. --fisheye reads the four coefficients
+// of a fisheye calibration; --balance and --fov-scale set its undistorted view.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "camera_calibration.h"
+#include "json_output.h"
+
+namespace {
+
+struct Options {
+    std::string input;
+    std::string calibration;
+    std::string out;
+    int workers = 2;
+    int queue = 8;
+    std::string fourcc = "MJPG";
+    int jpeg_quality = 95;
+    bool fisheye = false;
+    double balance = 0;
+    double fov_scale = 1;
+};
+
+struct Frame {
+    size_t index;
+    std::string name;
+    cv::Mat image;
+};
+
+// Blocking bounded FIFO between two stages; pop() returns false once the
+// queue is closed and drained.
+class FrameQueue {
+
+public:
+    explicit FrameQueue(size_t capacity):
+            capacity(capacity),
+            closed(false),
+            deepest(0) {}
+
+    void push(Frame frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return frames.size() < capacity; });
+        frames.push_back(std::move(frame));
+        deepest = std::max(deepest, frames.size());
+        not_empty.notify_one();
+    }
+
+    bool pop(Frame& frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !frames.empty(); });
+        if (frames.empty())
+            return false;
+        frame = std::move(frames.front());
+        frames.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+    size_t max_depth() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return deepest;
+    }
+
+private:
+    const size_t capacity;
+    mutable std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<Frame> frames;
+    bool closed;
+    size_t deepest;
+};
+
+// Busy time of one stage summed over its threads.
+struct StageClock {
+    std::atomic<int64_t> busy_us;
+
+    StageClock():
+            busy_us(0) {}
+
+    template <typename Fn>
+    auto time(Fn fn) -> decltype(fn()) {
+        struct Add {
+            std::atomic<int64_t>& total;
+            std::chrono::steady_clock::time_point begin;
+            ~Add() {
+                total += std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - begin).count();
+            }
+        } add {busy_us, std::chrono::steady_clock::now()};
+        return fn();
+    }
+};
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--fisheye")) {
+            options.fisheye = true;
+            continue;
+        }
+        if (arg[0] != '-' && options.input.empty()) {
+            options.input = arg;
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+            return false;
+        if (!strcmp(arg, "--calibration")) {
+            options.calibration = value;
+        } else if (!strcmp(arg, "--out")) {
+            options.out = value;
+        } else if (!strcmp(arg, "--workers")) {
+            options.workers = atoi(value);
+        } else if (!strcmp(arg, "--queue")) {
+            options.queue = atoi(value);
+        } else if (!strcmp(arg, "--fourcc") && strlen(value) == 4) {
+            options.fourcc = value;
+        } else if (!strcmp(arg, "--jpeg-quality")) {
+            options.jpeg_quality = atoi(value);
+        } else if (!strcmp(arg, "--balance")) {
+            options.balance = atof(value);
+        } else if (!strcmp(arg, "--fov-scale")) {
+            options.fov_scale = atof(value);
+        } else {
+            return false;
+        }
+        ++i;
+    }
+    return !options.input.empty() && !options.calibration.empty() && !options.out.empty()
+           && options.workers > 0 && options.queue > 0;
+}
+
+bool is_directory(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+std::vector<std::string> list_images(const std::string& directory) {
+    std::vector<cv::String> files;
+    cv::glob(directory, files, false);
+    std::vector<std::string> images;
+    const char* extensions[] = {".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff"};
+    for (const cv::String& file : files) {
+        std::string lower = file;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        for (const char* extension : extensions)
+            if (lower.size() > strlen(extension) && !lower.compare(lower.size() - strlen(extension), std::string::npos, extension))
+                images.push_back(file);
+    }
+    return images;
+}
+
+std::string base_name(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        fprintf(stderr, "usage: %s INPUT --calibration FILE --out PATH [--workers N] [--queue N] [--fourcc XXXX] [--jpeg-quality N]"
+                        " [--fisheye] [--balance B] [--fov-scale F]\n",
+                argv[0]);
+        return 2;
+    }
+    cv::Mat camera_matrix, dist_coeffs;
+    {
+        cv::FileStorage storage(options.calibration, cv::FileStorage::READ);
+        if (storage.isOpened()) {
+            storage["camera_matrix"] >> camera_matrix;
+            storage["dist_coeffs"] >> dist_coeffs;
+        }
+    }
+    if (camera_matrix.size() != cv::Size(3, 3) || dist_coeffs.empty() || (options.fisheye && dist_coeffs.total() != 4)) {
+        fprintf(stderr, "no camera_matrix and dist_coeffs in %s\n", options.calibration.c_str());
+        return 1;
+    }
+
+    bool video = !is_directory(options.input);
+    std::vector<std::string> images;
+    cv::VideoCapture capture;
+    cv::VideoWriter writer;
+    if (video) {
+        if (!capture.open(options.input)) {
+            fprintf(stderr, "cannot open %s\n", options.input.c_str());
+            return 1;
+        }
+        cv::Size size(static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+                      static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+        double fps = capture.get(cv::CAP_PROP_FPS);
+        const std::string& code = options.fourcc;
+        if (!writer.open(options.out, cv::VideoWriter::fourcc(code[0], code[1], code[2], code[3]),
+                         fps > 0 ? fps : 30.0, size)) {
+            fprintf(stderr, "cannot write %s\n", options.out.c_str());
+            return 1;
+        }
+        options.workers = 1;
+    } else {
+        images = list_images(options.input);
+        if (!is_directory(options.out)) {
+            fprintf(stderr, "%s is not a folder\n", options.out.c_str());
+            return 1;
+        }
+    }
+
+    CameraCalibration calibration;
+    calibration.set_adaptive_quality(false);
+    calibration.set_lens_model(options.fisheye ? LensModel::Fisheye : LensModel::Pinhole, options.balance,
+                               options.fov_scale);
+    FrameQueue decoded(options.queue), undistorted(options.queue);
+    StageClock decode_clock, remap_clock, encode_clock;
+    std::atomic<size_t> next_image(0), frames(0), failures(0);
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> decoders;
+    for (int i = 0; i < options.workers; ++i)
+        decoders.emplace_back([&] {
+            Frame frame;
+            if (video) {
+                while (decode_clock.time([&] { return capture.read(frame.image); })) {
+                    frame.index = frames++;
+                    decoded.push(std::move(frame));
+                }
+                return;
+            }
+            size_t index;
+            while ((index = next_image.fetch_add(1)) < images.size()) {
+                frame.index = index;
+                frame.name = base_name(images[index]);
+                frame.image = decode_clock.time([&] { return cv::imread(images[index], cv::IMREAD_UNCHANGED); });
+                if (frame.image.empty()) {
+                    fprintf(stderr, "cannot read %s\n", images[index].c_str());
+                    ++failures;
+                    continue;
+                }
+                ++frames;
+                decoded.push(std::move(frame));
+            }
+        });
+
+    // One remap thread: it owns the calibration and its cached maps, and the
+    // remap is already spread over the pool's latency workers.
+    std::thread remapper([&] {
+        Frame frame;
+        while (decoded.pop(frame)) {
+            remap_clock.time([&] {
+                calibration.undistort_image(frame.image, camera_matrix, dist_coeffs);
+                return 0;
+            });
+            undistorted.push(std::move(frame));
+        }
+        undistorted.close();
+    });
+
+    std::vector<std::thread> encoders;
+    for (int i = 0; i < options.workers; ++i)
+        encoders.emplace_back([&] {
+            Frame frame;
+            std::vector<int> params {cv::IMWRITE_JPEG_QUALITY, options.jpeg_quality};
+            while (undistorted.pop(frame)) {
+                bool saved = encode_clock.time([&] {
+                    if (video) {
+                        writer.write(frame.image);
+                        return true;
+                    }
+                    return cv::imwrite(options.out + "/" + frame.name, frame.image, params);
+                });
+                if (!saved) {
+                    fprintf(stderr, "cannot write %s\n", frame.name.c_str());
+                    ++failures;
+                }
+            }
+        });
+
+    for (std::thread& decoder : decoders)
+        decoder.join();
+    decoded.close();
+    remapper.join();
+    for (std::thread& encoder : encoders)
+        encoder.join();
+    writer.release();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t count = frames.load();
+    printf("{\n  \"input\": %s,\n  \"kind\": \"%s\",\n  \"frames\": %zu,\n  \"failures\": %zu,\n"
+           "  \"seconds\": %.3f,\n  \"fps\": %.2f,\n  \"workers\": %d,\n",
+           json_string(options.input).c_str(), video ? "video" : "images", count, failures.load(), seconds,
+           seconds > 0 ? count / seconds : 0.0, options.workers);
+    printf("  \"busy_seconds\": {\"decode\": %.3f, \"remap\": %.3f, \"encode\": %.3f},\n",
+           decode_clock.busy_us.load() / 1e6, remap_clock.busy_us.load() / 1e6, encode_clock.busy_us.load() / 1e6);
+    printf("  \"max_queue_depth\": {\"decoded\": %zu, \"undistorted\": %zu}\n}\n",
+           decoded.max_depth(), undistorted.max_depth());
+    return failures.load() ? 1 : 0;
+}
@@ -0,0 +1,414 @@
+// Host benchmark of the CameraCalibration frame and solve paths on synthetic
+// chessboard frames. Every measured call is wrapped in wall-clock timing and
+// hardware counters summed over all of the process's threads, so the stripes
+// thread pool workers run are included; results are aggregated per stage and
+// printed as JSON.
+//
+//   calibration-bench [--size WxH] [--board WxH] [--square N] [--frames N]
+//                     [--repeats N] [--seed N] [--solver dense|sparse|select]
+//                     [--max-views N] [--bootstrap N] [--detect-workers N]
+//                     [--budget-ms N] [--autotune] [--out FILE]
+//
+// The frame scheduler stays at full quality unless --budget-ms is given.
+// --autotune tunes detection on the frames first and measures with the result.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "camera_calibration.h"
+#include "perf_counters.h"
+#include "synthetic_views.h"
+
+namespace {
+
+struct Options {
+    cv::Size image_size = cv::Size(1280, 720);
+    cv::Size board_size = cv::Size(11, 7);
+    int square_size = 50;
+    int frames = 60;
+    int repeats = 3;
+    uint64_t seed = 1;
+    CalibrationSolver solver = CalibrationSolver::Dense;
+    int max_views = 20;
+    int bootstrap_samples = 100;
+    int detect_workers = 1;
+    double budget_ms = 0;
+    bool autotune = false;
+    std::string out;
+};
+
+struct StageAggregate {
+    std::string name;
+    std::vector<double> wall_ms;
+    std::array<uint64_t, PerfCounters::CounterCount> counters;
+    std::array<bool, PerfCounters::CounterCount> valid;
+
+    explicit StageAggregate(const std::string& name):
+            name(name) {
+        counters.fill(0);
+        valid.fill(true);
+    }
+};
+
+class StageBench {
+
+public:
+    explicit StageBench(PerfCounters& perf):
+            perf(perf) {}
+
+    template <typename Fn>
+    void measure(StageAggregate& stage, Fn fn) {
+        perf.start();
+        auto begin = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        PerfCounters::Reading reading = perf.stop();
+
+        stage.wall_ms.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+        for (int i = 0; i < PerfCounters::CounterCount; ++i) {
+            stage.valid[i] = stage.valid[i] && reading.valid[i];
+            stage.counters[i] += reading.values[i];
+        }
+    }
+
+    // For work timed by the library itself, outside a measured call; no counters.
+    void record(StageAggregate& stage, double wall_ms) {
+        stage.wall_ms.push_back(wall_ms);
+        stage.valid.fill(false);
+    }
+
+private:
+    PerfCounters& perf;
+};
+
+bool parse_size(const char* text, cv::Size& size) {
+    return sscanf(text, "%dx%d", &size.width, &size.height) == 2 && size.width > 0 && size.height > 0;
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--autotune")) {
+            options.autotune = true;
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+            return false;
+        if (!strcmp(arg, "--size") && parse_size(value, options.image_size)) {
+        } else if (!strcmp(arg, "--board") && parse_size(value, options.board_size)) {
+        } else if (!strcmp(arg, "--square")) {
+            options.square_size = atoi(value);
+        } else if (!strcmp(arg, "--frames")) {
+            options.frames = atoi(value);
+        } else if (!strcmp(arg, "--repeats")) {
+            options.repeats = atoi(value);
+        } else if (!strcmp(arg, "--seed")) {
+            options.seed = strtoull(value, nullptr, 10);
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "dense")) {
+            options.solver = CalibrationSolver::Dense;
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "sparse")) {
+            options.solver = CalibrationSolver::Sparse;
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "select")) {
+            options.solver = CalibrationSolver::ModelSelection;
+        } else if (!strcmp(arg, "--max-views")) {
+            options.max_views = atoi(value);
+        } else if (!strcmp(arg, "--budget-ms")) {
+            options.budget_ms = atof(value);
+        } else if (!strcmp(arg, "--detect-workers")) {
+            options.detect_workers = atoi(value);
+        } else if (!strcmp(arg, "--bootstrap")) {
+            options.bootstrap_samples = atoi(value);
+        } else if (!strcmp(arg, "--out")) {
+            options.out = value;
+        } else {
+            return false;
+        }
+        ++i;
+    }
+    return options.frames > 0 && options.repeats > 0 && options.square_size > 0 && options.max_views > 0
+           && options.bootstrap_samples >= 0;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(fraction * (values.size() - 1) + 0.5)];
+}
+
+void write_stage(FILE* out, const StageAggregate& stage, bool last) {
+    double total = 0;
+    for (double ms : stage.wall_ms)
+        total += ms;
+    size_t samples = stage.wall_ms.size();
+
+    fprintf(out, "    {\"name\": \"%s\", \"samples\": %zu, \"wall_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"max\": %.4f}",
+            stage.name.c_str(), samples, samples ? total / samples : 0.0,
+            percentile(stage.wall_ms, 0.5), percentile(stage.wall_ms, 0.95), percentile(stage.wall_ms, 1.0));
+    fprintf(out, ", \"counters_per_call\": {");
+    for (int i = 0; i < PerfCounters::CounterCount; ++i) {
+        const char* name = PerfCounters::counter_name(static_cast<PerfCounters::Counter>(i));
+        if (stage.valid[i] && samples)
+            fprintf(out, "%s\"%s\": %.1f", i ? ", " : "", name, static_cast<double>(stage.counters[i]) / samples);
+        else
+            fprintf(out, "%s\"%s\": null", i ? ", " : "", name);
+    }
+    fprintf(out, "}");
+    if (stage.valid[PerfCounters::Cycles] && stage.valid[PerfCounters::Instructions] && stage.counters[PerfCounters::Cycles])
+        fprintf(out, ", \"ipc\": %.3f",
+                static_cast<double>(stage.counters[PerfCounters::Instructions]) / stage.counters[PerfCounters::Cycles]);
+    fprintf(out, "}%s\n", last ? "" : ",");
+}
+
+// Error of a solve against the synthetic ground truth.
+void write_accuracy(FILE* out, const char* tier, const SolveReport& report, const SyntheticCamera& truth, bool last) {
+    const cv::Mat& k = report.camera_matrix;
+    const cv::Mat& t = truth.camera_matrix;
+    fprintf(out, "    {\"tier\": \"%s\", \"seconds\": %.5f, \"rms\": %.5f, \"fx_error_pct\": %.4f, \"fy_error_pct\": %.4f, "
+                 "\"cx_error_px\": %.4f, \"cy_error_px\": %.4f, \"k1_error\": %.6f}%s\n",
+            tier, report.seconds, report.rms,
+            100.0 * (k.at<double>(0, 0) - t.at<double>(0, 0)) / t.at<double>(0, 0),
+            100.0 * (k.at<double>(1, 1) - t.at<double>(1, 1)) / t.at<double>(1, 1),
+            k.at<double>(0, 2) - t.at<double>(0, 2), k.at<double>(1, 2) - t.at<double>(1, 2),
+            report.dist_coeffs.at<double>(0) - truth.dist_coeffs.at<double>(0), last ? "" : ",");
+}
+
+// Intervals next to the synthetic ground truth they should cover.
+void write_bootstrap(FILE* out, const BootstrapResult& result, const SyntheticCamera& truth) {
+    const cv::Mat& k = truth.camera_matrix;
+    double truth_values[] = {k.at<double>(0, 0), k.at<double>(1, 1), k.at<double>(0, 2), k.at<double>(1, 2),
+                             truth.dist_coeffs.at<double>(0), truth.dist_coeffs.at<double>(1),
+                             truth.dist_coeffs.at<double>(2), truth.dist_coeffs.at<double>(3),
+                             truth.dist_coeffs.at<double>(4)};
+    fprintf(out, ",\n  \"bootstrap\": {\"samples\": %d, \"failed\": %d, \"confidence\": %.3f, \"seconds\": %.4f, "
+                 "\"needs_more_views\": %s, \"parameters\": [\n",
+            result.samples, result.failed, result.confidence, result.seconds,
+            result.needs_more_views() ? "true" : "false");
+    for (size_t i = 0; i < result.parameters.size(); ++i) {
+        const ParameterInterval& p = result.parameters[i];
+        fprintf(out, "    {\"name\": \"%s\", \"estimate\": %.6f, \"lower\": %.6f, \"upper\": %.6f, \"std_dev\": %.6f, "
+                     "\"truth\": %.6f, \"covers_truth\": %s}%s\n",
+                p.name, p.estimate, p.lower, p.upper, p.std_dev, truth_values[i],
+                p.lower <= truth_values[i] && truth_values[i] <= p.upper ? "true" : "false",
+                i + 1 < result.parameters.size() ? "," : "");
+    }
+    fprintf(out, "  ]}");
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--size WxH] [--board WxH] [--square N] [--frames N] [--repeats N] [--seed N] [--solver dense|sparse|select] [--max-views N] [--bootstrap N] [--detect-workers N] [--budget-ms N] [--autotune] [--out FILE]\n",
+                argv[0]);
+        return 2;
+    }
+
+    SyntheticCamera camera = SyntheticCamera::typical(options.image_size);
+    std::vector<SyntheticView> views = render_views(camera, options.board_size, options.square_size,
+                                                    options.frames, options.seed);
+
+    PerfCounters perf;
+    StageBench bench(perf);
+    StageAggregate identify("identify_chessboard");
+    StageAggregate solve("calibrate");
+    StageAggregate undistort("undistort_image");
+    StageAggregate solve_fast("calibrate_fast");
+    StageAggregate solve_refine("refine_in_background");
+    StageAggregate bootstrap("bootstrap");
+    StageAggregate pose("board_pose");
+    StageAggregate refine_fixed("refine_cornersubpix");
+    StageAggregate refine_adaptive("refine_adaptive");
+    StageAggregate points_lut("undistort_points_lut");
+    StageAggregate points_iterative("undistort_points_iterative");
+
+    CameraCalibration calibration;
+    calibration.set_sizes(options.board_size, options.image_size, options.square_size);
+    calibration.set_solver(options.solver, options.max_views);
+    calibration.set_detection_workers(options.detect_workers);
+    calibration.set_adaptive_quality(options.budget_ms > 0);
+    if (options.budget_ms > 0)
+        calibration.set_frame_budget(std::chrono::microseconds(static_cast<int64_t>(options.budget_ms * 1000)));
+
+    cv::Mat frame;
+    int snapshots = 0;
+    DetectionTuning tuning = {};
+    if (options.autotune) {
+        calibration.collect_tuning_frames(views.size() / 5 + 1);
+        for (const SyntheticView& view : views) {
+            view.frame.copyTo(frame);
+            calibration.identify_chessboard(frame, false);
+        }
+        tuning = calibration.tune_detection();
+        calibration.reset_stats();
+    }
+    for (int repeat = 0; repeat < options.repeats; ++repeat) {
+        for (const SyntheticView& view : views) {
+            view.frame.copyTo(frame);
+            bench.measure(identify, [&] {
+                snapshots = calibration.identify_chessboard(frame, true);
+            });
+        }
+    }
+
+    // Subpixel refinement alone: the old fixed 11x11 cornerSubPix against the
+    // adaptive per-corner refiner, on the same detections.
+    double refine_difference = 0;
+    size_t refined_points = 0;
+    cv::Mat gray;
+    std::vector<cv::Point2f> detected, fixed, adaptive;
+    for (const SyntheticView& view : views) {
+        cv::cvtColor(view.frame, gray, cv::COLOR_BGRA2GRAY);
+        if (!cv::findChessboardCorners(gray, options.board_size, detected,
+                                       cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK))
+            continue;
+        for (int repeat = 0; repeat < options.repeats; ++repeat) {
+            fixed = adaptive = detected;
+            bench.measure(refine_fixed, [&] {
+                cv::cornerSubPix(gray, fixed, cv::Size(11, 11), cv::Size(-1, -1),
+                                 cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
+            });
+            bench.measure(refine_adaptive, [&] { CornerRefiner().refine(gray, options.board_size, adaptive); });
+        }
+        for (size_t i = 0; i < fixed.size(); ++i)
+            refine_difference += cv::norm(fixed[i] - adaptive[i]);
+        refined_points += fixed.size();
+    }
+
+    std::vector<cv::Mat> results;
+    SolveReport preview = {}, refined = {};
+    BootstrapResult intervals = {};
+    double points_error = 0;
+    int poses_valid = 0, poses_warm = 0;
+    double pose_rms_max = 0;
+    if (snapshots > 3) {
+        for (int repeat = 0; repeat < options.repeats; ++repeat)
+            bench.measure(solve, [&] { results = calibration.calibrate(); });
+
+        for (int repeat = 0; repeat < options.repeats; ++repeat) {
+            bench.measure(solve_fast, [&] { preview = calibration.calibrate_fast(); });
+            calibration.refine_in_background(preview);
+            refined = calibration.refined_result();
+            bench.record(solve_refine, refined.seconds * 1000.0);
+        }
+
+        if (options.bootstrap_samples > 0)
+            bench.measure(bootstrap, [&] {
+                intervals = calibration.bootstrap(results[0], results[1], options.bootstrap_samples);
+            });
+
+        for (int repeat = 0; repeat < options.repeats; ++repeat) {
+            for (const SyntheticView& view : views) {
+                view.frame.copyTo(frame);
+                bench.measure(undistort, [&] { calibration.undistort_image(frame, results[0], results[1]); });
+            }
+        }
+
+        // Frames in sequence, as in the preview, so consecutive poses can warm start.
+        for (int repeat = 0; repeat < options.repeats; ++repeat) {
+            for (const SyntheticView& view : views) {
+                view.frame.copyTo(frame);
+                calibration.identify_chessboard(frame, false);
+                BoardPose board_pose = {};
+                bench.measure(pose, [&] { board_pose = calibration.board_pose(results[0], results[1]); });
+                poses_valid += board_pose.valid;
+                poses_warm += board_pose.valid && board_pose.warm_started;
+                if (board_pose.valid)
+                    pose_rms_max = std::max(pose_rms_max, board_pose.rms);
+            }
+        }
+
+        // An overlay-sized batch: a 40x25 grid over the whole frame.
+        std::vector<cv::Point2f> points, lut, iterative;
+        for (int y = 0; y < 25; ++y)
+            for (int x = 0; x < 40; ++x)
+                points.emplace_back((x + 0.5f) * options.image_size.width / 40, (y + 0.5f) * options.image_size.height / 25);
+        for (int repeat = 0; repeat < options.repeats * 20; ++repeat) {
+            bench.measure(points_lut, [&] { calibration.undistort_points(points, lut, results[0], results[1]); });
+            bench.measure(points_iterative, [&] {
+                cv::undistortPoints(points, iterative, results[0], results[1], cv::noArray(), results[0]);
+            });
+        }
+        cv::undistortPoints(points, iterative, results[0], results[1], cv::noArray(), results[0],
+                            cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, 1e-10));
+        for (size_t i = 0; i < points.size(); ++i)
+            points_error = std::max(points_error, cv::norm(lut[i] - iterative[i]));
+    }
+
+    FILE* out = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", options.out.c_str());
+        return 1;
+    }
+    PipelineStats::Snapshot snapshot = calibration.stats_snapshot();
+    fprintf(out, "{\n  \"image_size\": [%d, %d],\n  \"board_size\": [%d, %d],\n  \"frames\": %d,\n  \"repeats\": %d,\n  \"detect_workers\": %d,\n",
+            options.image_size.width, options.image_size.height,
+            options.board_size.width, options.board_size.height, options.frames, options.repeats,
+            options.detect_workers);
+    const char* solver_names[] = {"dense", "sparse", "select"};
+    fprintf(out, "  \"solver\": \"%s\",\n  \"distortion_model\": \"%s\",\n",
+            solver_names[static_cast<int>(options.solver)], calibration.selected_distortion_model().c_str());
+    fprintf(out, "  \"perf_counters_available\": %s,\n  \"perf_threads\": %d,\n  \"snapshots\": %d,\n  \"detection_hit_rate\": %.3f,\n  \"frames_dropped\": %llu,\n"
+                 "  \"frame_scheduler\": {\"budget_ms\": %.2f, \"detection_level\": %llu, \"remap_level\": %llu, \"changes\": %llu},\n",
+            perf.available() ? "true" : "false", perf.threads(), snapshots, snapshot.hit_rate(),
+            static_cast<unsigned long long>(snapshot.frames_dropped), options.budget_ms,
+            static_cast<unsigned long long>(snapshot.detection_level),
+            static_cast<unsigned long long>(snapshot.remap_level),
+            static_cast<unsigned long long>(snapshot.quality_changes));
+    if (options.autotune) {
+        const DetectionConfig& best = tuning.best;
+        fprintf(out, "  \"autotune\": {\"frames\": %d, \"square_px\": %.2f, \"best\": {\"flags\": %d, \"pyramid_level\": %d, "
+                     "\"subpix_window\": %d, \"subpix_iterations\": %d}, \"candidates\": [\n",
+                tuning.frames, tuning.square_px, best.flags, best.pyramid_level, best.subpix_window, best.subpix_iterations);
+        for (size_t i = 0; i < tuning.candidates.size(); ++i) {
+            const DetectionCandidate& candidate = tuning.candidates[i];
+            fprintf(out, "    {\"flags\": %d, \"pyramid_level\": %d, \"subpix_window\": %d, \"subpix_iterations\": %d, "
+                         "\"detect_ms\": %.3f, \"refine_ms\": %.3f, \"hit_rate\": %.3f, \"corner_error_px\": %.4f}%s\n",
+                    candidate.config.flags, candidate.config.pyramid_level, candidate.config.subpix_window,
+                    candidate.config.subpix_iterations, candidate.detect_ms, candidate.refine_ms, candidate.hit_rate,
+                    candidate.corner_error, i + 1 < tuning.candidates.size() ? "," : "");
+        }
+        fprintf(out, "  ]},\n");
+    }
+    fprintf(out, "  \"refinement_mean_difference_px\": %.4f,\n",
+            refined_points ? refine_difference / refined_points : 0.0);
+    fprintf(out, "  \"stages\": [\n");
+    write_stage(out, identify, false);
+    write_stage(out, solve, false);
+    write_stage(out, solve_fast, false);
+    write_stage(out, solve_refine, false);
+    write_stage(out, bootstrap, false);
+    write_stage(out, undistort, false);
+    write_stage(out, pose, false);
+    write_stage(out, refine_fixed, false);
+    write_stage(out, refine_adaptive, false);
+    write_stage(out, points_lut, false);
+    write_stage(out, points_iterative, true);
+    fprintf(out, "  ]");
+    if (snapshots > 3) {
+        SolveReport dense = {results[0], results[1], 0.0, percentile(solve.wall_ms, 0.5) / 1000.0};
+        fprintf(out, ",\n  \"accuracy\": [\n");
+        write_accuracy(out, "calibrate", dense, camera, false);
+        write_accuracy(out, "fast_lu", preview, camera, false);
+        write_accuracy(out, "refined_svd", refined, camera, true);
+        fprintf(out, "  ]");
+        if (options.bootstrap_samples > 0)
+            write_bootstrap(out, intervals, camera);
+        fprintf(out, ",\n  \"undistort_points\": {\"lut_max_error_px\": %.5f, \"grid_max_error_px\": %.5f}",
+                calibration.point_undistortion_error(), points_error);
+        fprintf(out, ",\n  \"board_pose\": {\"valid\": %d, \"warm_started\": %d, \"max_rms_px\": %.4f}",
+                poses_valid, poses_warm, pose_rms_max);
+    }
+    fprintf(out, "\n}\n");
+    if (out != stdout)
+        fclose(out);
+    return snapshots > 3 ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+// Re-solves saved calibration datasets with CameraCalibration::calibrate()
+// (or calibrate_fast()) and prints one JSON record per dataset, so solver
+// settings can be compared across many devices without recapturing.
+//
+//   calibration-resolve DATASET... [--solver dense|sparse|select] [--fast]
+//                       [--fisheye] [--max-views N] [--min-quality X] [--out FILE]
+//
+// --fast only goes with the dense solver. --fisheye solves the fisheye lens
+// model instead, whatever the solver. --max-views keeps the first N views,
+// --min-quality drops views whose board covers less than that share of the
+// frame. The reported rms is the reprojection error over the kept views with
+// the solved intrinsics.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "calibration_dataset.h"
+#include "camera_calibration.h"
+#include "json_output.h"
+
+namespace {
+
+struct Options {
+    std::vector<std::string> datasets;
+    CalibrationSolver solver = CalibrationSolver::Dense;
+    bool fast = false;
+    bool fisheye = false;
+    int max_views = 0;
+    double min_quality = 0;
+    std::string out;
+};
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--fast")) {
+            options.fast = true;
+            continue;
+        }
+        if (!strcmp(arg, "--fisheye")) {
+            options.fisheye = true;
+            continue;
+        }
+        if (arg[0] != '-') {
+            options.datasets.push_back(arg);
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+            return false;
+        if (!strcmp(arg, "--solver") && !strcmp(value, "dense")) {
+            options.solver = CalibrationSolver::Dense;
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "sparse")) {
+            options.solver = CalibrationSolver::Sparse;
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "select")) {
+            options.solver = CalibrationSolver::ModelSelection;
+        } else if (!strcmp(arg, "--max-views")) {
+            options.max_views = atoi(value);
+        } else if (!strcmp(arg, "--min-quality")) {
+            options.min_quality = atof(value);
+        } else if (!strcmp(arg, "--out")) {
+            options.out = value;
+        } else {
+            return false;
+        }
+        ++i;
+    }
+    // calibrate_fast() is the dense LU solve whatever the solver.
+    return !options.datasets.empty() && options.max_views >= 0
+           && !(options.fast && options.solver != CalibrationSolver::Dense);
+}
+
+void write_values(FILE* out, const char* name, const cv::Mat& values) {
+    fprintf(out, ", \"%s\": [", name);
+    for (int i = 0; i < static_cast<int>(values.total()); ++i)
+        fprintf(out, "%s%.9g", i ? ", " : "", values.at<double>(i));
+    fprintf(out, "]");
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        fprintf(stderr, "usage: %s DATASET... [--solver dense|sparse|select] [--fast] [--fisheye] [--max-views N] [--min-quality X] [--out FILE]\n",
+                argv[0]);
+        return 2;
+    }
+    FILE* out = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", options.out.c_str());
+        return 1;
+    }
+
+    const char* solver_names[] = {"dense", "sparse", "select"};
+    int failures = 0;
+    fprintf(out, "[\n");
+    for (size_t d = 0; d < options.datasets.size(); ++d) {
+        const std::string& path = options.datasets[d];
+        CalibrationDataset dataset;
+        bool loaded = CalibrationDataset::load(path, dataset);
+        if (loaded) {
+            std::vector<DatasetView> kept;
+            for (const DatasetView& view : dataset.views)
+                if (view.quality >= options.min_quality
+                    && (options.max_views == 0 || static_cast<int>(kept.size()) < options.max_views))
+                    kept.push_back(view);
+            dataset.views.swap(kept);
+        }
+        fprintf(out, "  {\"dataset\": %s", json_string(path).c_str());
+        if (!loaded || dataset.views.size() < 4) {
+            fprintf(out, ", \"error\": \"%s\"}%s\n", loaded ? "too few views" : "unreadable",
+                    d + 1 < options.datasets.size() ? "," : "");
+            ++failures;
+            continue;
+        }
+
+        CameraCalibration calibration;
+        calibration.set_solver(options.solver, dataset.views.size());
+        calibration.set_lens_model(options.fisheye ? LensModel::Fisheye : LensModel::Pinhole);
+        calibration.load_dataset(dataset);
+        SolveReport report;
+        auto start = std::chrono::steady_clock::now();
+        if (options.fast) {
+            report = calibration.calibrate_fast();
+        } else {
+            std::vector<cv::Mat> results = calibration.calibrate();
+            report.camera_matrix = results[0];
+            report.dist_coeffs = results[1];
+        }
+        double solve_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        double squared = 0;
+        for (double error : calibration.view_errors(report.camera_matrix, report.dist_coeffs))
+            squared += error * error;
+
+        fprintf(out, ", \"device\": %s, \"views\": %zu, \"solver\": \"%s\", \"fast\": %s, \"model\": \"%s\", "
+                     "\"solve_ms\": %.3f, \"rms\": %.5f",
+                json_string(dataset.device).c_str(), dataset.views.size(), solver_names[static_cast<int>(options.solver)],
+                options.fast ? "true" : "false", calibration.selected_distortion_model().c_str(), solve_ms,
+                std::sqrt(squared / dataset.views.size()));
+        write_values(out, "camera_matrix", report.camera_matrix);
+        write_values(out, "dist_coeffs", report.dist_coeffs);
+        fprintf(out, "}%s\n", d + 1 < options.datasets.size() ? "," : "");
+        fflush(out);
+    }
+    fprintf(out, "]\n");
+    if (out != stdout)
+        fclose(out);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+// Headless batch calibration of many saved datasets in one process. Worker
+// threads take the next unsolved dataset as soon as they finish one, each
+// reusing its own CameraCalibration, and every result is appended to the
+// output as one JSON line the moment it is ready. Rerunning with the same
+// output resumes: datasets already solved in the file are skipped.
+//
+//   calibration-fleet --out FILE [--list FILE] [DATASET...] [--jobs N]
+//                     [--solver dense|sparse|select] [--max-views N]
+//
+// --list reads one dataset path per line. The shared thread pool is
+// configured without workers so each dataset is solved on the thread that
+// claimed it, one dataset per core.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "calibration_dataset.h"
+#include "camera_calibration.h"
+#include "json_output.h"
+
+namespace {
+
+struct Options {
+    std::vector<std::string> datasets;
+    std::string out;
+    int jobs = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    CalibrationSolver solver = CalibrationSolver::Dense;
+    int max_views = 0;
+};
+
+bool read_list(const char* path, std::vector<std::string>& datasets) {
+    FILE* list = fopen(path, "r");
+    if (!list)
+        return false;
+    char line[4096];
+    while (fgets(line, sizeof(line), list)) {
+        size_t length = strcspn(line, "\r\n");
+        if (length)
+            datasets.emplace_back(line, length);
+    }
+    fclose(list);
+    return true;
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            options.datasets.push_back(arg);
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+            return false;
+        if (!strcmp(arg, "--out")) {
+            options.out = value;
+        } else if (!strcmp(arg, "--list")) {
+            if (!read_list(value, options.datasets))
+                return false;
+        } else if (!strcmp(arg, "--jobs")) {
+            options.jobs = atoi(value);
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "dense")) {
+            options.solver = CalibrationSolver::Dense;
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "sparse")) {
+            options.solver = CalibrationSolver::Sparse;
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "select")) {
+            options.solver = CalibrationSolver::ModelSelection;
+        } else if (!strcmp(arg, "--max-views")) {
+            options.max_views = atoi(value);
+        } else {
+            return false;
+        }
+        ++i;
+    }
+    return !options.out.empty() && !options.datasets.empty() && options.jobs > 0 && options.max_views >= 0;
+}
+
+// Strings are escaped, so an unescaped `, "error": ` is always the key.
+bool is_error_record(const std::string& record) {
+    return record.find(", \"error\": ") != std::string::npos;
+}
+
+// Dataset paths of the solved lines in a previous run's output; datasets that
+// failed are tried again. A line cut short by an interruption is truncated
+// away so the file stays valid JSON Lines.
+std::set<std::string> finished_datasets(const std::string& path) {
+    std::set<std::string> finished;
+    FILE* previous = fopen(path.c_str(), "r");
+    if (!previous)
+        return finished;
+    const char prefix[] = "{\"dataset\": \"";
+    std::string line;
+    long complete_bytes = 0;
+    int c;
+    while ((c = fgetc(previous)) != EOF) {
+        if (c != '\n') {
+            line.push_back(static_cast<char>(c));
+            continue;
+        }
+        complete_bytes = ftell(previous);
+        if (!line.compare(0, sizeof(prefix) - 1, prefix) && !is_error_record(line)) {
+            std::string dataset;
+            for (size_t i = sizeof(prefix) - 1; i < line.size() && line[i] != '"'; ++i) {
+                if (line[i] != '\\' || i + 1 == line.size()) {
+                    dataset += line[i];
+                } else if (line[++i] == 'u') {
+                    dataset += static_cast<char>(strtol(line.substr(i + 1, 4).c_str(), nullptr, 16));
+                    i += 4;
+                } else {
+                    dataset += line[i];
+                }
+            }
+            finished.insert(dataset);
+        }
+        line.clear();
+    }
+    fclose(previous);
+    if (!line.empty() && truncate(path.c_str(), complete_bytes) != 0)
+        fprintf(stderr, "cannot drop the incomplete last line of %s\n", path.c_str());
+    return finished;
+}
+
+void append_values(std::string& record, const char* name, const double* values, size_t count) {
+    char number[32];
+    record += ", \"";
+    record += name;
+    record += "\": [";
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(number, sizeof(number), "%s%.9g", i ? ", " : "", values[i]);
+        record += number;
+    }
+    record += "]";
+}
+
+// One JSON line; failures carry an "error" instead of a solution.
+std::string solve_dataset(CameraCalibration& calibration, const std::string& path, const Options& options) {
+    const char* solver_names[] = {"dense", "sparse", "select"};
+    std::string record = "{\"dataset\": " + json_string(path);
+    char buffer[256];
+
+    auto start = std::chrono::steady_clock::now();
+    CalibrationDataset dataset;
+    if (!CalibrationDataset::load(path, dataset))
+        return record + ", \"error\": \"unreadable\"}\n";
+    if (options.max_views > 0 && dataset.views.size() > static_cast<size_t>(options.max_views))
+        dataset.views.resize(options.max_views);
+    if (dataset.views.size() < 4)
+        return record + ", \"error\": \"too few views\"}\n";
+    auto loaded = std::chrono::steady_clock::now();
+
+    try {
+        calibration.set_solver(options.solver, dataset.views.size());
+        calibration.load_dataset(dataset);
+        std::vector<cv::Mat> results = calibration.calibrate();
+        auto solved = std::chrono::steady_clock::now();
+        std::vector<double> errors = calibration.view_errors(results[0], results[1]);
+        double squared = 0;
+        for (double error : errors)
+            squared += error * error;
+
+        record += ", \"device\": " + json_string(dataset.device);
+        snprintf(buffer, sizeof(buffer),
+                 ", \"views\": %zu, \"solver\": \"%s\", \"model\": \"%s\", \"rms\": %.5f"
+                 ", \"load_ms\": %.3f, \"solve_ms\": %.3f",
+                 dataset.views.size(), solver_names[static_cast<int>(options.solver)],
+                 calibration.selected_distortion_model().c_str(), std::sqrt(squared / errors.size()),
+                 std::chrono::duration<double, std::milli>(loaded - start).count(),
+                 std::chrono::duration<double, std::milli>(solved - loaded).count());
+        record += buffer;
+        append_values(record, "camera_matrix", results[0].ptr<double>(), results[0].total());
+        append_values(record, "dist_coeffs", results[1].ptr<double>(), results[1].total());
+        append_values(record, "view_errors", errors.data(), errors.size());
+        return record + "}\n";
+    } catch (const cv::Exception&) {
+        // Degenerate views; report the dataset and keep going.
+        return record + ", \"error\": \"solve failed\"}\n";
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        fprintf(stderr, "usage: %s --out FILE [--list FILE] [DATASET...] [--jobs N] [--solver dense|sparse|select] [--max-views N]\n",
+                argv[0]);
+        return 2;
+    }
+
+    std::set<std::string> finished = finished_datasets(options.out);
+    std::vector<std::string> pending;
+    for (const std::string& dataset : options.datasets)
+        if (!finished.count(dataset))
+            pending.push_back(dataset);
+    FILE* out = fopen(options.out.c_str(), "a");
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", options.out.c_str());
+        return 1;
+    }
+
+    ThreadPool::Config config = ThreadPool::Config::defaults();
+    config.latency_workers = 0;
+    config.background_workers = 0;
+    config.pin_threads = false;
+    ThreadPool::configure_shared(config);
+
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> failed(0);
+    std::mutex output_mutex;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < std::min(options.jobs, static_cast<int>(pending.size())); ++i)
+        workers.emplace_back([&] {
+            CameraCalibration calibration;
+            size_t index;
+            while ((index = next.fetch_add(1)) < pending.size()) {
+                std::string record = solve_dataset(calibration, pending[index], options);
+                if (is_error_record(record))
+                    failed.fetch_add(1);
+                // Whole lines only, flushed at once, so an interruption loses at most the line being written.
+                std::lock_guard<std::mutex> lock(output_mutex);
+                fwrite(record.data(), 1, record.size(), out);
+                fflush(out);
+            }
+        });
+    for (std::thread& worker : workers)
+        worker.join();
+    fclose(out);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%zu solved, %zu failed, %zu skipped as already done, %.2f s, %.1f datasets/s\n",
+            pending.size() - failed.load(), failed.load(), options.datasets.size() - pending.size(), seconds,
+            seconds > 0 ? pending.size() / seconds : 0.0);
+    return failed.load() ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+// Replays a FrameRecorder recording through the same CameraCalibration calls
+// the app makes: identify_chessboard on every frame (requesting a snapshot
+// where the recording flagged one), calibrate(), then undistort_image on every
+// frame with the result. Frames are fed as fast as possible or, with
+// --realtime, at their recorded timestamps. Prints timings and the outcome as
+// JSON.
+//
+//   calibration-replay RECORDING [--board WxH] [--square N] [--realtime]
+//                      [--snapshot-every N] [--solver dense|sparse|select]
+//                      [--max-views N] [--detect-workers N] [--budget-ms N]
+//                      [--reference FILE] [--tolerance X] [--out FILE]
+//
+// --reference writes the accepted snapshots and the calibration to FILE the
+// first time and compares against it afterwards, exiting with 3 on a
+// mismatch. The outcome is only reproducible with one detection worker and
+// no frame budget, both of which make it depend on timing.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera_calibration.h"
+#include "frame_recorder.h"
+#include "json_output.h"
+
+namespace {
+
+struct Options {
+    std::string recording;
+    cv::Size board_size = cv::Size(11, 7);
+    int square_size = 50;
+    bool realtime = false;
+    int snapshot_every = 0;
+    CalibrationSolver solver = CalibrationSolver::Dense;
+    int max_views = 20;
+    int detect_workers = 1;
+    double budget_ms = 0;
+    std::string reference;
+    double tolerance = 1e-6;
+    std::string out;
+};
+
+struct Outcome {
+    std::vector<int> snapshots;     // sequences of the accepted snapshot frames
+    cv::Mat camera_matrix;
+    cv::Mat dist_coeffs;
+};
+
+bool parse_size(const char* text, cv::Size& size) {
+    return sscanf(text, "%dx%d", &size.width, &size.height) == 2 && size.width > 0 && size.height > 0;
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--realtime")) {
+            options.realtime = true;
+            continue;
+        }
+        if (arg[0] != '-' && options.recording.empty()) {
+            options.recording = arg;
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+            return false;
+        if (!strcmp(arg, "--board") && parse_size(value, options.board_size)) {
+        } else if (!strcmp(arg, "--square")) {
+            options.square_size = atoi(value);
+        } else if (!strcmp(arg, "--snapshot-every")) {
+            options.snapshot_every = atoi(value);
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "dense")) {
+            options.solver = CalibrationSolver::Dense;
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "sparse")) {
+            options.solver = CalibrationSolver::Sparse;
+        } else if (!strcmp(arg, "--solver") && !strcmp(value, "select")) {
+            options.solver = CalibrationSolver::ModelSelection;
+        } else if (!strcmp(arg, "--max-views")) {
+            options.max_views = atoi(value);
+        } else if (!strcmp(arg, "--detect-workers")) {
+            options.detect_workers = atoi(value);
+        } else if (!strcmp(arg, "--budget-ms")) {
+            options.budget_ms = atof(value);
+        } else if (!strcmp(arg, "--reference")) {
+            options.reference = value;
+        } else if (!strcmp(arg, "--tolerance")) {
+            options.tolerance = atof(value);
+        } else if (!strcmp(arg, "--out")) {
+            options.out = value;
+        } else {
+            return false;
+        }
+        ++i;
+    }
+    return !options.recording.empty() && options.square_size > 0 && options.max_views > 0
+           && options.snapshot_every >= 0 && options.tolerance >= 0;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(fraction * (values.size() - 1) + 0.5)];
+}
+
+void write_timing(FILE* out, const char* name, const std::vector<double>& wall_ms) {
+    double total = 0;
+    for (double ms : wall_ms)
+        total += ms;
+    fprintf(out, "  \"%s\": {\"samples\": %zu, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"max\": %.4f},\n",
+            name, wall_ms.size(), wall_ms.empty() ? 0.0 : total / wall_ms.size(),
+            percentile(wall_ms, 0.5), percentile(wall_ms, 0.95), percentile(wall_ms, 1.0));
+}
+
+void write_values(FILE* out, const char* name, const cv::Mat& values) {
+    fprintf(out, "  \"%s\": [", name);
+    for (int i = 0; i < static_cast<int>(values.total()); ++i)
+        fprintf(out, "%s%.9g", i ? ", " : "", values.at<double>(i));
+    fprintf(out, "],\n");
+}
+
+// Same relative scale for every parameter: differences against 1 + |value|.
+bool close_enough(const cv::Mat& a, const cv::Mat& b, double tolerance) {
+    if (a.total() != b.total())
+        return false;
+    for (int i = 0; i < static_cast<int>(a.total()); ++i) {
+        double expected = b.at<double>(i);
+        if (std::abs(a.at<double>(i) - expected) > tolerance * (1 + std::abs(expected)))
+            return false;
+    }
+    return true;
+}
+
+// "written", "match" or "mismatch".
+const char* check_reference(const std::string& path, const Outcome& outcome, double tolerance) {
+    cv::FileStorage input(path, cv::FileStorage::READ);
+    if (!input.isOpened()) {
+        cv::FileStorage output(path, cv::FileStorage::WRITE);
+        output << "snapshots" << outcome.snapshots;
+        output << "camera_matrix" << outcome.camera_matrix;
+        output << "dist_coeffs" << outcome.dist_coeffs;
+        return "written";
+    }
+    Outcome expected;
+    input["snapshots"] >> expected.snapshots;
+    input["camera_matrix"] >> expected.camera_matrix;
+    input["dist_coeffs"] >> expected.dist_coeffs;
+    bool match = expected.snapshots == outcome.snapshots
+            && close_enough(outcome.camera_matrix, expected.camera_matrix, tolerance)
+            && close_enough(outcome.dist_coeffs, expected.dist_coeffs, tolerance);
+    return match ? "match" : "mismatch";
+}
+
+// The preview delivers RGBA; converting back to gray in identify_chessboard
+// gives the recorded luma exactly for Y8 recordings.
+void to_rgba(const cv::Mat& recorded, FrameFormat format, cv::Mat& rgba) {
+    if (format == FrameFormat::NV21)
+        cv::cvtColor(recorded, rgba, cv::COLOR_YUV2RGBA_NV21);
+    else
+        cv::cvtColor(recorded, rgba, cv::COLOR_GRAY2RGBA);
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        fprintf(stderr, "usage: %s RECORDING [--board WxH] [--square N] [--realtime] [--snapshot-every N] [--solver dense|sparse|select] [--max-views N] [--detect-workers N] [--budget-ms N] [--reference FILE] [--tolerance X] [--out FILE]\n",
+                argv[0]);
+        return 2;
+    }
+    FrameRecording recording;
+    if (!recording.open(options.recording) || recording.size() == 0) {
+        fprintf(stderr, "cannot read %s\n", options.recording.c_str());
+        return 1;
+    }
+    const RecordedFrameEntry& first = recording.entry(0);
+    cv::Size image_size(first.width, first.height);
+
+    CameraCalibration calibration;
+    calibration.set_sizes(options.board_size, image_size, options.square_size);
+    calibration.set_solver(options.solver, options.max_views);
+    calibration.set_detection_workers(options.detect_workers);
+    calibration.set_adaptive_quality(options.budget_ms > 0);
+    if (options.budget_ms > 0)
+        calibration.set_frame_budget(std::chrono::microseconds(static_cast<int64_t>(options.budget_ms * 1000)));
+
+    Outcome outcome;
+    std::vector<double> identify_ms, undistort_ms;
+    double lag_ms = 0;
+    cv::Mat frame;
+    int views = 0;
+    auto replay_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < recording.size(); ++i) {
+        const RecordedFrameEntry& entry = recording.entry(i);
+        if (options.realtime) {
+            auto due = replay_start + std::chrono::nanoseconds(entry.timestamp_ns - first.timestamp_ns);
+            std::this_thread::sleep_until(due);
+            lag_ms = std::max(lag_ms, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - due).count());
+        }
+        bool snapshot = options.snapshot_every > 0 ? i % options.snapshot_every == 0
+                      : (entry.flags & FrameRecorder::Snapshot) != 0;
+        to_rgba(recording.frame(i), static_cast<FrameFormat>(entry.format), frame);
+        auto begin = std::chrono::steady_clock::now();
+        int count = calibration.identify_chessboard(frame, snapshot);
+        identify_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        if (count > views)
+            outcome.snapshots.push_back(static_cast<int>(entry.sequence));
+        views = count;
+    }
+    double replay_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start).count();
+
+    double calibrate_ms = 0;
+    const char* reference = "none";
+    if (views > 3) {
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<cv::Mat> results = calibration.calibrate();
+        calibrate_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        outcome.camera_matrix = results[0];
+        outcome.dist_coeffs = results[1];
+        for (size_t i = 0; i < recording.size(); ++i) {
+            to_rgba(recording.frame(i), static_cast<FrameFormat>(recording.entry(i).format), frame);
+            begin = std::chrono::steady_clock::now();
+            calibration.undistort_image(frame, outcome.camera_matrix, outcome.dist_coeffs);
+            undistort_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        }
+        if (!options.reference.empty())
+            reference = check_reference(options.reference, outcome, options.tolerance);
+    }
+
+    FILE* out = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", options.out.c_str());
+        return 1;
+    }
+    const RecordingHeader& header = recording.header();
+    PipelineStats::Snapshot snapshot = calibration.stats_snapshot();
+    fprintf(out, "{\n  \"recording\": %s,\n  \"device\": %s,\n  \"image_size\": [%d, %d],\n",
+            json_string(options.recording).c_str(),
+            json_string(std::string(header.device, strnlen(header.device, sizeof(header.device)))).c_str(),
+            image_size.width, image_size.height);
+    fprintf(out, "  \"frames\": %zu,\n  \"frames_dropped_while_recording\": %llu,\n  \"mode\": \"%s\",\n"
+                 "  \"detect_workers\": %d,\n  \"seconds\": %.4f,\n  \"fps\": %.2f,\n  \"max_lag_ms\": %.3f,\n",
+            recording.size(), static_cast<unsigned long long>(header.frames_dropped),
+            options.realtime ? "realtime" : "max_speed", options.detect_workers, replay_seconds,
+            replay_seconds > 0 ? recording.size() / replay_seconds : 0.0, lag_ms);
+    fprintf(out, "  \"detection_hit_rate\": %.3f,\n  \"frames_dropped\": %llu,\n",
+            snapshot.hit_rate(), static_cast<unsigned long long>(snapshot.frames_dropped));
+    write_timing(out, "identify_ms", identify_ms);
+    write_timing(out, "undistort_ms", undistort_ms);
+    fprintf(out, "  \"calibrate_ms\": %.3f,\n  \"snapshots\": [", calibrate_ms);
+    for (size_t i = 0; i < outcome.snapshots.size(); ++i)
+        fprintf(out, "%s%d", i ? ", " : "", outcome.snapshots[i]);
+    fprintf(out, "],\n");
+    if (views > 3) {
+        write_values(out, "camera_matrix", outcome.camera_matrix);
+        write_values(out, "dist_coeffs", outcome.dist_coeffs);
+    }
+    fprintf(out, "  \"reference\": \"%s\"\n}\n", reference);
+    if (out != stdout)
+        fclose(out);
+    if (!strcmp(reference, "mismatch"))
+        return 3;
+    return views > 3 ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+#include "json_output.h"
+
+#include <cstdio>
+
+std::string json_string(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            quoted += code;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
@@ -0,0 +1,10 @@
+#ifndef TESTAPP_JSON_OUTPUT_H
+#define TESTAPP_JSON_OUTPUT_H
+
+#include <string>
+
+// `text` as a quoted JSON string, for the paths and device names the tools
+// print into their reports.
+std::string json_string(const std::string& text);
+
+#endif //TESTAPP_JSON_OUTPUT_H
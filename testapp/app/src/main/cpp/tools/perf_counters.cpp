@@ -0,0 +1,128 @@
+#include "perf_counters.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const uint64_t hardware_events[PerfCounters::CounterCount] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+int open_counter(pid_t tid, uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, tid, -1, group_fd, 0));
+}
+
+}
+
+PerfCounters::PerfCounters():
+        calling_thread_counted(false) {
+    attach_new_threads();
+}
+
+PerfCounters::~PerfCounters() {
+    for (const Group& group : groups)
+        for (int fd : group.fds)
+            if (fd >= 0)
+                close(fd);
+}
+
+bool PerfCounters::available() const {
+    return calling_thread_counted;
+}
+
+int PerfCounters::threads() const {
+    return static_cast<int>(groups.size());
+}
+
+void PerfCounters::attach_new_threads() {
+    DIR* tasks = opendir("/proc/self/task");
+    if (!tasks)
+        return;
+    pid_t self = static_cast<pid_t>(syscall(SYS_gettid));
+    while (dirent* entry = readdir(tasks)) {
+        pid_t tid = static_cast<pid_t>(atoi(entry->d_name));
+        if (tid <= 0)
+            continue;
+        bool known = false;
+        for (const Group& group : groups)
+            known = known || group.tid == tid;
+        if (known)
+            continue;
+        Group group;
+        group.tid = tid;
+        group.leader = -1;
+        for (int i = 0; i < CounterCount; ++i) {
+            group.fds[i] = open_counter(tid, hardware_events[i], group.leader);
+            if (group.fds[i] >= 0 && group.leader == -1)
+                group.leader = group.fds[i];
+        }
+        if (group.leader < 0)
+            continue;
+        calling_thread_counted = calling_thread_counted || tid == self;
+        groups.push_back(group);
+    }
+    closedir(tasks);
+}
+
+void PerfCounters::start() {
+    attach_new_threads();
+    for (const Group& group : groups) {
+        ioctl(group.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+PerfCounters::Reading PerfCounters::stop() {
+    Reading reading;
+    reading.valid.fill(false);
+    reading.values.fill(0);
+    for (const Group& group : groups)
+        ioctl(group.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    // A counter is valid when every thread could read it.
+    for (int i = 0; i < CounterCount && !groups.empty(); ++i) {
+        bool valid = true;
+        double total = 0;
+        for (const Group& group : groups) {
+            uint64_t data[3];
+            if (group.fds[i] < 0 || read(group.fds[i], data, sizeof(data)) != sizeof(data)) {
+                valid = false;
+                break;
+            }
+            // Not scheduled while enabled: nothing to add.
+            if (data[2] != 0)
+                total += data[0] * (static_cast<double>(data[1]) / data[2]);
+        }
+        reading.values[i] = static_cast<uint64_t>(total);
+        reading.valid[i] = valid;
+    }
+    return reading;
+}
+
+const char* PerfCounters::counter_name(Counter counter) {
+    switch (counter) {
+        case Cycles: return "cycles";
+        case Instructions: return "instructions";
+        case CacheMisses: return "cache_misses";
+        case BranchMisses: return "branch_misses";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TESTAPP_PERF_COUNTERS_H
+#define TESTAPP_PERF_COUNTERS_H
+
+#include <array>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+// Hardware counters for every thread of the process via perf_event_open, one
+// counter group per thread summed on stop(), so stages striped over the
+// thread pool are counted on its workers too. Threads are picked up on each
+// start(); one created in the middle of a measurement is missed, and work of
+// unrelated threads running at the same time is included. Counters the kernel
+// refuses (perf_event_paranoid, missing PMU, containers) are reported as
+// invalid instead of failing the run; values are scaled when the kernel had
+// to multiplex them.
+class PerfCounters {
+
+public:
+    enum Counter {
+        Cycles,
+        Instructions,
+        CacheMisses,
+        BranchMisses,
+        CounterCount
+    };
+
+    struct Reading {
+        std::array<bool, CounterCount> valid;
+        std::array<uint64_t, CounterCount> values;
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    void start();
+    Reading stop();
+    // Threads with counters open so far.
+    int threads() const;
+
+    static const char* counter_name(Counter counter);
+
+private:
+    struct Group {
+        pid_t tid;
+        std::array<int, CounterCount> fds;
+        int leader;
+    };
+
+    void attach_new_threads();
+
+    std::vector<Group> groups;
+    bool calling_thread_counted;
+};
+
+#endif //TESTAPP_PERF_COUNTERS_H
@@ -0,0 +1,198 @@
+// Stereo calibration and rectification of recorded image pairs. The two
+// folders hold one image per camera for each moment, paired by sorted file
+// name; pairs where the board is not found in both images are skipped.
+//
+//   calibration-stereo FIRST_DIR SECOND_DIR --board WxH --square N [--alpha A]
+//                      [--out FILE] [--rectified DIR]
+//   calibration-stereo FIRST_DIR SECOND_DIR --calibration FILE --rectified DIR
+//
+// --out writes the StereoResult as a cv::FileStorage file; --calibration
+// loads one instead of solving, to rectify another recording with it.
+// --rectified writes each rectified pair side by side as <name> in DIR, with
+// horizontal lines every 32 rows so the row alignment can be checked by eye.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "stereo_calibration.h"
+
+namespace {
+
+struct Options {
+    std::string first;
+    std::string second;
+    cv::Size board;
+    int square = 0;
+    double alpha = 0;
+    std::string out;
+    std::string calibration;
+    std::string rectified;
+};
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            if (options.first.empty())
+                options.first = arg;
+            else if (options.second.empty())
+                options.second = arg;
+            else
+                return false;
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+            return false;
+        if (!strcmp(arg, "--board")) {
+            if (sscanf(value, "%dx%d", &options.board.width, &options.board.height) != 2)
+                return false;
+        } else if (!strcmp(arg, "--square")) {
+            options.square = atoi(value);
+        } else if (!strcmp(arg, "--alpha")) {
+            options.alpha = atof(value);
+        } else if (!strcmp(arg, "--out")) {
+            options.out = value;
+        } else if (!strcmp(arg, "--calibration")) {
+            options.calibration = value;
+        } else if (!strcmp(arg, "--rectified")) {
+            options.rectified = value;
+        } else {
+            return false;
+        }
+        ++i;
+    }
+    if (options.first.empty() || options.second.empty())
+        return false;
+    if (!options.calibration.empty())
+        return !options.rectified.empty();
+    return options.board.area() > 0 && options.square > 0;
+}
+
+std::vector<std::string> list_images(const std::string& directory) {
+    std::vector<cv::String> files;
+    cv::glob(directory, files, false);
+    std::vector<std::string> images;
+    const char* extensions[] = {".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff"};
+    for (const cv::String& file : files) {
+        std::string lower = file;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        for (const char* extension : extensions)
+            if (lower.size() > strlen(extension) && !lower.compare(lower.size() - strlen(extension), std::string::npos, extension))
+                images.push_back(file);
+    }
+    std::sort(images.begin(), images.end());
+    return images;
+}
+
+std::string base_name(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+void print_matrix(const char* name, const cv::Mat& matrix, bool last = false) {
+    cv::Mat values;
+    matrix.convertTo(values, CV_64F);
+    printf("  \"%s\": [", name);
+    for (size_t i = 0; i < values.total(); ++i)
+        printf("%s%.9g", i ? ", " : "", values.ptr<double>()[i]);
+    printf("]%s\n", last ? "" : ",");
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        fprintf(stderr, "usage: %s FIRST_DIR SECOND_DIR (--board WxH --square N [--alpha A] [--out FILE] | --calibration FILE)"
+                        " [--rectified DIR]\n", argv[0]);
+        return 2;
+    }
+    std::vector<std::string> first = list_images(options.first);
+    std::vector<std::string> second = list_images(options.second);
+    if (first.size() != second.size() || first.empty()) {
+        fprintf(stderr, "%zu images in %s but %zu in %s\n", first.size(), options.first.c_str(), second.size(),
+                options.second.c_str());
+        return 1;
+    }
+
+    StereoCalibration stereo;
+    double detect_ms = 0, solve_ms = 0;
+    if (!options.calibration.empty()) {
+        StereoResult loaded;
+        if (!StereoResult::load(options.calibration, loaded)) {
+            fprintf(stderr, "no stereo calibration in %s\n", options.calibration.c_str());
+            return 1;
+        }
+        stereo.set_result(loaded);
+    } else {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < first.size(); ++i) {
+            cv::Mat images[] = {cv::imread(first[i], cv::IMREAD_GRAYSCALE), cv::imread(second[i], cv::IMREAD_GRAYSCALE)};
+            if (images[0].empty() || images[1].empty()) {
+                fprintf(stderr, "cannot read %s or %s\n", first[i].c_str(), second[i].c_str());
+                return 1;
+            }
+            if (!i)
+                stereo.set_sizes(options.board, images[0].size(), options.square);
+            stereo.add_pair(images[0], images[1]);
+        }
+        auto detected = std::chrono::steady_clock::now();
+        if (stereo.pairs() < 4) {
+            fprintf(stderr, "board found in both images of %zu pairs, need 4\n", stereo.pairs());
+            return 1;
+        }
+        try {
+            stereo.calibrate(options.alpha);
+        } catch (const cv::Exception&) {
+            fprintf(stderr, "stereo calibration failed\n");
+            return 1;
+        }
+        detect_ms = std::chrono::duration<double, std::milli>(detected - start).count();
+        solve_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - detected).count();
+        if (!options.out.empty() && !stereo.result().save(options.out)) {
+            fprintf(stderr, "cannot write %s\n", options.out.c_str());
+            return 1;
+        }
+    }
+
+    double rectify_ms = 0;
+    size_t rectified = 0;
+    if (!options.rectified.empty()) {
+        cv::Mat rectified_first, rectified_second, side_by_side;
+        for (size_t i = 0; i < first.size(); ++i) {
+            cv::Mat images[] = {cv::imread(first[i]), cv::imread(second[i])};
+            auto start = std::chrono::steady_clock::now();
+            if (!stereo.rectify(images[0], images[1], rectified_first, rectified_second)) {
+                fprintf(stderr, "cannot rectify %s and %s\n", first[i].c_str(), second[i].c_str());
+                continue;
+            }
+            rectify_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            cv::hconcat(rectified_first, rectified_second, side_by_side);
+            for (int y = 0; y < side_by_side.rows; y += 32)
+                cv::line(side_by_side, cv::Point(0, y), cv::Point(side_by_side.cols - 1, y), cv::Scalar(0, 255, 0));
+            if (cv::imwrite(options.rectified + "/" + base_name(first[i]), side_by_side))
+                ++rectified;
+            else
+                fprintf(stderr, "cannot write %s\n", base_name(first[i]).c_str());
+        }
+    }
+
+    const StereoResult& result = stereo.result();
+    printf("{\n  \"images\": %zu,\n  \"pairs\": %zu,\n  \"rms\": %.5f,\n", first.size(), stereo.pairs(), result.rms);
+    printf("  \"detect_ms\": %.3f,\n  \"solve_ms\": %.3f,\n  \"rectified\": %zu,\n  \"mean_rectify_ms\": %.3f,\n",
+           detect_ms, solve_ms, rectified, rectified ? rectify_ms / rectified : 0.0);
+    print_matrix("camera_matrix_1", result.camera_matrix[0]);
+    print_matrix("camera_matrix_2", result.camera_matrix[1]);
+    print_matrix("R", result.r);
+    print_matrix("T", result.t, true);
+    printf("}\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "synthetic_views.h"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace {
+
+const int texture_square_px = 24;
+const int texture_margin_squares = 1;
+
+cv::Mat board_texture(const cv::Size& board) {
+    int squares_x = board.width + 1 + 2 * texture_margin_squares;
+    int squares_y = board.height + 1 + 2 * texture_margin_squares;
+    cv::Mat texture(squares_y * texture_square_px, squares_x * texture_square_px, CV_8UC1, cv::Scalar(255));
+    for (int y = 0; y <= board.height; ++y)
+        for (int x = 0; x <= board.width; ++x)
+            if ((x + y) % 2 == 0)
+                cv::rectangle(texture,
+                              cv::Rect((x + texture_margin_squares) * texture_square_px,
+                                       (y + texture_margin_squares) * texture_square_px,
+                                       texture_square_px, texture_square_px),
+                              cv::Scalar(0), cv::FILLED);
+    return texture;
+}
+
+// For every pixel of the distorted image, the pixel of the ideal pinhole
+// image it samples from.
+void distortion_maps(const SyntheticCamera& camera, cv::Mat& map_x, cv::Mat& map_y) {
+    const cv::Size& size = camera.image_size;
+    std::vector<cv::Point2f> distorted;
+    distorted.reserve(size.area());
+    for (int y = 0; y < size.height; ++y)
+        for (int x = 0; x < size.width; ++x)
+            distorted.emplace_back(static_cast<float>(x), static_cast<float>(y));
+
+    std::vector<cv::Point2f> ideal;
+    cv::undistortPoints(distorted, ideal, camera.camera_matrix, camera.dist_coeffs,
+                        cv::noArray(), camera.camera_matrix);
+
+    map_x.create(size, CV_32FC1);
+    map_y.create(size, CV_32FC1);
+    for (int y = 0; y < size.height; ++y) {
+        float* row_x = map_x.ptr<float>(y);
+        float* row_y = map_y.ptr<float>(y);
+        for (int x = 0; x < size.width; ++x) {
+            const cv::Point2f& point = ideal[static_cast<size_t>(y) * size.width + x];
+            row_x[x] = point.x;
+            row_y[x] = point.y;
+        }
+    }
+}
+
+}
+
+SyntheticCamera SyntheticCamera::typical(const cv::Size& image_size) {
+    SyntheticCamera camera;
+    camera.image_size = image_size;
+    double focal = 0.9 * image_size.width;
+    camera.camera_matrix = (cv::Mat_<double>(3, 3) <<
+            focal, 0, (image_size.width - 1) / 2.0,
+            0, focal, (image_size.height - 1) / 2.0,
+            0, 0, 1);
+    camera.dist_coeffs = (cv::Mat_<double>(5, 1) << -0.12, 0.05, 0.0008, -0.0005, 0.0);
+    return camera;
+}
+
+std::vector<SyntheticView> render_views(const SyntheticCamera& camera, const cv::Size& board,
+                                        int square_size, int count, uint64_t seed) {
+    cv::RNG rng(seed);
+    cv::Mat texture = board_texture(board);
+    cv::Mat map_x, map_y;
+    distortion_maps(camera, map_x, map_y);
+
+    // Texture pixels to board-plane units, origin on the first inner corner.
+    double units_per_px = static_cast<double>(square_size) / texture_square_px;
+    double origin_px = (1 + texture_margin_squares) * texture_square_px;
+    cv::Mat texture_to_board = (cv::Mat_<double>(3, 3) <<
+            units_per_px, 0, -origin_px * units_per_px,
+            0, units_per_px, -origin_px * units_per_px,
+            0, 0, 1);
+
+    double board_width = square_size * (board.width - 1.0);
+    double board_height = square_size * (board.height - 1.0);
+    double focal = camera.camera_matrix.at<double>(0, 0);
+
+    std::vector<SyntheticView> views;
+    views.reserve(count);
+    cv::Mat ideal, distorted;
+    for (int i = 0; i < count; ++i) {
+        SyntheticView view;
+        view.r_vec = (cv::Mat_<double>(3, 1) <<
+                rng.uniform(-0.45, 0.45), rng.uniform(-0.45, 0.45), rng.uniform(-0.3, 0.3));
+        // Keep the board at 45-80% of the frame width.
+        double distance = focal * board_width / (camera.image_size.width * rng.uniform(0.45, 0.8));
+        cv::Mat rotation;
+        cv::Rodrigues(view.r_vec, rotation);
+        cv::Mat center = rotation * (cv::Mat_<double>(3, 1) << board_width / 2, board_height / 2, 0);
+        double shift = 0.1 * distance;
+        view.t_vec = (cv::Mat_<double>(3, 1) <<
+                rng.uniform(-shift, shift), rng.uniform(-shift, shift), distance);
+        view.t_vec -= center;
+
+        cv::Mat extrinsic(3, 3, CV_64F);
+        rotation.col(0).copyTo(extrinsic.col(0));
+        rotation.col(1).copyTo(extrinsic.col(1));
+        view.t_vec.copyTo(extrinsic.col(2));
+        cv::Mat homography = camera.camera_matrix * extrinsic * texture_to_board;
+
+        cv::warpPerspective(texture, ideal, homography, camera.image_size, cv::INTER_LINEAR,
+                            cv::BORDER_CONSTANT, cv::Scalar(160));
+        cv::remap(ideal, distorted, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(160));
+        cv::cvtColor(distorted, view.frame, cv::COLOR_GRAY2BGRA);
+        views.push_back(view);
+    }
+    return views;
+}
@@ -0,0 +1,28 @@
+#ifndef TESTAPP_SYNTHETIC_VIEWS_H
+#define TESTAPP_SYNTHETIC_VIEWS_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Ground-truth camera used to render synthetic chessboard frames.
+struct SyntheticCamera {
+    cv::Size image_size;
+    cv::Mat camera_matrix;
+    cv::Mat dist_coeffs;
+
+    static SyntheticCamera typical(const cv::Size& image_size);
+};
+
+struct SyntheticView {
+    cv::Mat frame;
+    cv::Mat r_vec;
+    cv::Mat t_vec;
+};
+
+// Renders `count` BGRA frames of a chessboard with `board` inner corners seen
+// from varied poses through `camera`, lens distortion included. Poses are
+// drawn from a fixed seed so runs are reproducible.
+std::vector<SyntheticView> render_views(const SyntheticCamera& camera, const cv::Size& board,
+                                        int square_size, int count, uint64_t seed = 1);
+
+#endif //TESTAPP_SYNTHETIC_VIEWS_H
@@ -0,0 +1,143 @@
+#include "trace_recorder.h"
+
+#include <cstdio>
+#include <thread>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+thread_local int64_t current_frame = -1;
+std::atomic<int> writers(0);
+
+int32_t current_tid() {
+    static thread_local int32_t tid = static_cast<int32_t>(syscall(SYS_gettid));
+    return tid;
+}
+
+// Keeps stop() from serialising the buffer while an event is half written.
+// Registering and then checking `active` against stop() clearing it and then
+// checking the writers is a store-load handshake: both sides need seq_cst, or
+// each can miss the other's store and a late writer races events.reset().
+struct WriterGuard {
+    WriterGuard() { writers.fetch_add(1, std::memory_order_seq_cst); }
+    ~WriterGuard() { writers.fetch_sub(1, std::memory_order_release); }
+};
+
+}
+
+TraceRecorder& TraceRecorder::instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::TraceRecorder():
+        active(false),
+        next_event(0),
+        dropped_events(0),
+        capacity(0) {
+}
+
+bool TraceRecorder::start(const std::string& trace_path, size_t event_capacity) {
+    if (active.load() || event_capacity == 0)
+        return false;
+    events.reset(new Event[event_capacity]);
+    capacity = event_capacity;
+    path = trace_path;
+    next_event.store(0);
+    dropped_events.store(0);
+    origin = std::chrono::steady_clock::now();
+    active.store(true, std::memory_order_release);
+    return true;
+}
+
+long TraceRecorder::stop() {
+    if (!active.exchange(false, std::memory_order_seq_cst))
+        return -1;
+    while (writers.load(std::memory_order_seq_cst) != 0)
+        std::this_thread::yield();
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file)
+        return -1;
+
+    size_t count = std::min(next_event.load(), capacity);
+    int pid = static_cast<int>(getpid());
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":%zu},\"traceEvents\":[",
+            dropped_events.load());
+    for (size_t i = 0; i < count; ++i) {
+        const Event& event = events[i];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":%d,\"tid\":%d,",
+                i ? "," : "", event.name, event.category, event.phase,
+                static_cast<long long>(event.ts_us), pid, event.tid);
+        if (event.phase == 'X') {
+            fprintf(file, "\"dur\":%lld,\"args\":{\"frame\":%lld,\"cpu\":%d}}",
+                    static_cast<long long>(event.dur_us), static_cast<long long>(event.frame_id), event.cpu);
+        } else {
+            fprintf(file, "\"args\":{\"value\":%lld}}", static_cast<long long>(event.value));
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    events.reset();
+    capacity = 0;
+    return static_cast<long>(count);
+}
+
+void TraceRecorder::complete(const char* name, const char* category,
+                             std::chrono::steady_clock::time_point begin,
+                             std::chrono::steady_clock::time_point end) {
+    WriterGuard guard;
+    Event* event = claim();
+    if (!event)
+        return;
+    event->name = name;
+    event->category = category;
+    event->phase = 'X';
+    event->ts_us = since_origin(begin);
+    event->dur_us = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    event->frame_id = current_frame;
+    event->value = 0;
+    event->tid = current_tid();
+    event->cpu = sched_getcpu();
+}
+
+void TraceRecorder::counter(const char* name, int64_t value) {
+    if (!enabled())
+        return;
+    WriterGuard guard;
+    Event* event = claim();
+    if (!event)
+        return;
+    event->name = name;
+    event->category = "counter";
+    event->phase = 'C';
+    event->ts_us = since_origin(std::chrono::steady_clock::now());
+    event->dur_us = 0;
+    event->frame_id = current_frame;
+    event->value = value;
+    event->tid = current_tid();
+    event->cpu = sched_getcpu();
+}
+
+void TraceRecorder::set_frame(int64_t frame_id) {
+    current_frame = frame_id;
+}
+
+TraceRecorder::Event* TraceRecorder::claim() {
+    // Re-checked under the writer guard so stop() never races a late writer.
+    if (!active.load(std::memory_order_seq_cst))
+        return nullptr;
+    size_t index = next_event.fetch_add(1, std::memory_order_relaxed);
+    if (index >= capacity) {
+        dropped_events.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return &events[index];
+}
+
+int64_t TraceRecorder::since_origin(std::chrono::steady_clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - origin).count();
+}
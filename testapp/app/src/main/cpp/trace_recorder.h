@@ -0,0 +1,88 @@
+#ifndef TESTAPP_TRACE_RECORDER_H
+#define TESTAPP_TRACE_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Opt-in process-wide tracer producing Chrome trace-event JSON, which both
+// chrome://tracing and the Perfetto UI open. Events go into a buffer that is
+// preallocated by start(); when tracing is off every hook is a single relaxed
+// load. Event names must be string literals, they are stored by pointer.
+class TraceRecorder {
+
+public:
+    static TraceRecorder& instance();
+
+    bool start(const std::string& path, size_t capacity = 1u << 16u);
+    // Writes the buffered events to the path given to start(). Returns the
+    // number of events written, or -1 if the file could not be opened.
+    long stop();
+
+    bool enabled() const {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    void complete(const char* name, const char* category,
+                  std::chrono::steady_clock::time_point begin,
+                  std::chrono::steady_clock::time_point end);
+    void counter(const char* name, int64_t value);
+
+    // Frame id attached to events recorded from the calling thread.
+    static void set_frame(int64_t frame_id);
+
+private:
+    struct Event {
+        const char* name;
+        const char* category;
+        char phase;
+        int64_t ts_us;
+        int64_t dur_us;
+        int64_t frame_id;
+        int64_t value;
+        int32_t tid;
+        int32_t cpu;
+    };
+
+    TraceRecorder();
+    Event* claim();
+    int64_t since_origin(std::chrono::steady_clock::time_point time) const;
+
+    std::atomic<bool> active;
+    std::atomic<size_t> next_event;
+    std::atomic<size_t> dropped_events;
+    std::unique_ptr<Event[]> events;
+    size_t capacity;
+    std::string path;
+    std::chrono::steady_clock::time_point origin;
+};
+
+// Emits one complete ("X") event covering the enclosing block.
+class TraceSpan {
+
+public:
+    explicit TraceSpan(const char* name, const char* category = "native"):
+            name(name),
+            category(category),
+            armed(TraceRecorder::instance().enabled())
+            {
+                if (armed)
+                    begin = std::chrono::steady_clock::now();
+            };
+    ~TraceSpan() {
+        if (armed)
+            TraceRecorder::instance().complete(name, category, begin, std::chrono::steady_clock::now());
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    bool armed;
+    std::chrono::steady_clock::time_point begin;
+};
+
+#endif //TESTAPP_TRACE_RECORDER_H
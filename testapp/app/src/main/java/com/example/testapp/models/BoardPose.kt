@@ -0,0 +1,21 @@
+package com.example.testapp.models
+
+// Rodrigues rotation and translation of the board in camera coordinates,
+// translation in the units of squareSize.
+data class BoardPose(
+    val valid: Boolean,
+    val warmStarted: Boolean,
+    val rotation: FloatArray,
+    val translation: FloatArray,
+    val rms: Float) {
+
+    companion object {
+        // Mirrors BoardPose::to_array() in board_pose.cpp.
+        fun fromArray(values: FloatArray) = BoardPose(
+            values[0] != 0f,
+            values[1] != 0f,
+            values.copyOfRange(2, 5),
+            values.copyOfRange(5, 8),
+            values[8])
+    }
+}
@@ -0,0 +1,43 @@
+package com.example.testapp.models
+
+data class ParameterInterval(
+    val name: String,
+    val estimate: Double,
+    val lower: Double,
+    val upper: Double,
+    val stdDev: Double)
+
+data class CalibrationUncertainty(
+    val samples: Int,
+    val failed: Int,
+    val confidence: Double,
+    val seconds: Double,
+    val needsMoreViews: Boolean,
+    val parameters: List<ParameterInterval>) {
+
+    companion object {
+        private const val HEADER_FIELDS = 5
+        private const val PARAMETER_FIELDS = 4
+        private val PARAMETER_NAMES = listOf("fx", "fy", "cx", "cy", "k1", "k2", "p1", "p2", "k3")
+
+        // Mirrors BootstrapResult::to_array() in calibration_bootstrap.cpp.
+        fun fromArray(values: DoubleArray): CalibrationUncertainty {
+            val parameters = PARAMETER_NAMES.mapIndexed { index, name ->
+                val base = HEADER_FIELDS + index * PARAMETER_FIELDS
+                ParameterInterval(
+                    name,
+                    values[base],
+                    values[base + 1],
+                    values[base + 2],
+                    values[base + 3])
+            }
+            return CalibrationUncertainty(
+                values[0].toInt(),
+                values[1].toInt(),
+                values[2],
+                values[3],
+                values[4] != 0.0,
+                parameters)
+        }
+    }
+}
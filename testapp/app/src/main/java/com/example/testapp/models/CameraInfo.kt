@@ -7,4 +7,6 @@ import kotlinx.android.parcel.Parcelize
     val matrix: Long,
     val dist: Long,
     val matDump: String,
-    val distDump: String) : Parcelable
\ No newline at end of file
+    val distDump: String,
+    val rms: Double = 0.0,
+    val solveSeconds: Double = 0.0) : Parcelable
\ No newline at end of file
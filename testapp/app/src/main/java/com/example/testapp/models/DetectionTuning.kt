@@ -0,0 +1,25 @@
+package com.example.testapp.models
+
+data class DetectionTuning(
+    val frames: Int,
+    val squarePx: Double,
+    val flags: Int,
+    val pyramidLevel: Int,
+    val subpixWindow: Int,
+    val subpixIterations: Int,
+    val subpixEpsilon: Double,
+    val saved: Boolean) {
+
+    companion object {
+        // Mirrors the array built by nativeAutotuneDetection in native_lib.cpp.
+        fun fromArray(values: DoubleArray) = DetectionTuning(
+            values[0].toInt(),
+            values[1],
+            values[2].toInt(),
+            values[3].toInt(),
+            values[4].toInt(),
+            values[5].toInt(),
+            values[6],
+            values[7] != 0.0)
+    }
+}
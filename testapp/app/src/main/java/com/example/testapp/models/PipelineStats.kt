@@ -0,0 +1,57 @@
+package com.example.testapp.models
+
+data class StageStats(
+    val name: String,
+    val count: Long,
+    val p50Ms: Double,
+    val p95Ms: Double,
+    val p99Ms: Double,
+    val maxMs: Double)
+
+data class PipelineStats(
+    val framesProcessed: Long,
+    val framesDropped: Long,
+    val framesLate: Long,
+    val detectionsAttempted: Long,
+    val detectionsFound: Long,
+    val bytesAllocated: Long,
+    val bytesInUse: Long,
+    val detectionLevel: Int,
+    val remapLevel: Int,
+    val qualityChanges: Long,
+    val hitRate: Double,
+    val stages: List<StageStats>) {
+
+    companion object {
+        private const val COUNTER_FIELDS = 11
+        private const val STAGE_FIELDS = 5
+        private val STAGE_NAMES = listOf("gray", "detect", "refine", "draw", "remap", "solve", "pose")
+
+        // Mirrors PipelineStats::Snapshot::to_array() in pipeline_stats.cpp.
+        fun fromArray(values: DoubleArray): PipelineStats {
+            val stages = STAGE_NAMES.mapIndexed { index, name ->
+                val base = COUNTER_FIELDS + index * STAGE_FIELDS
+                StageStats(
+                    name,
+                    values[base].toLong(),
+                    values[base + 1],
+                    values[base + 2],
+                    values[base + 3],
+                    values[base + 4])
+            }
+            return PipelineStats(
+                values[0].toLong(),
+                values[1].toLong(),
+                values[2].toLong(),
+                values[3].toLong(),
+                values[4].toLong(),
+                values[5].toLong(),
+                values[6].toLong(),
+                values[7].toInt(),
+                values[8].toInt(),
+                values[9].toLong(),
+                values[10],
+                stages)
+        }
+    }
+}
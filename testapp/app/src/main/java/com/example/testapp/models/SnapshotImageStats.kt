@@ -0,0 +1,23 @@
+package com.example.testapp.models
+
+data class SnapshotImageStats(
+    val written: Long,
+    val dropped: Long,
+    val failed: Long,
+    val queueDepth: Int,
+    val maxQueueDepth: Int,
+    val meanWriteMs: Double,
+    val maxWriteMs: Double) {
+
+    companion object {
+        // Mirrors SnapshotWriter::Stats::to_array() in snapshot_writer.cpp.
+        fun fromArray(values: DoubleArray) = SnapshotImageStats(
+            values[0].toLong(),
+            values[1].toLong(),
+            values[2].toLong(),
+            values[3].toInt(),
+            values[4].toInt(),
+            values[5],
+            values[6])
+    }
+}
@@ -1,8 +1,15 @@
 package com.example.testapp.screencamera
 
+import android.os.Build
+import android.os.SystemClock
 import androidx.lifecycle.LiveData
 import androidx.lifecycle.MutableLiveData
+import com.example.testapp.models.BoardPose
+import com.example.testapp.models.CalibrationUncertainty
 import com.example.testapp.models.CameraInfo
+import com.example.testapp.models.DetectionTuning
+import com.example.testapp.models.PipelineStats
+import com.example.testapp.models.SnapshotImageStats
 import org.opencv.android.CameraBridgeViewBase
 import org.opencv.core.*
 
@@ -11,14 +18,22 @@ object CvCameraViewListener : CameraBridgeViewBase.CvCameraViewListener2 {
     private const val boardWidth = 11
     private const val boardHeight = 7
     private const val squareSize = 50
+    // Same bits as FrameRecorder::Flags.
+    private const val RECORD_SNAPSHOT = 1
     private var sizesSet = false
     private var modeTakeSnapshot = false
+    private var frameWidth = 0
+    private var frameHeight = 0
+    @Volatile private var recording = false
 
     private val mutableImagePointsCount = MutableLiveData<Int>()
     val imagePointsCount: LiveData<Int>
         get() = mutableImagePointsCount
 
-    override fun onCameraViewStarted(width: Int, height: Int) {}
+    override fun onCameraViewStarted(width: Int, height: Int) {
+        frameWidth = width
+        frameHeight = height
+    }
 
     override fun onCameraViewStopped() {}
 
@@ -31,6 +46,11 @@ object CvCameraViewListener : CameraBridgeViewBase.CvCameraViewListener2 {
             sizesSet = true
         }
 
+        if (recording) {
+            recordFrame(inputFrame.gray().nativeObjAddr, SystemClock.elapsedRealtimeNanos(),
+                if (modeTakeSnapshot) RECORD_SNAPSHOT else 0)
+        }
+
         mutableImagePointsCount.postValue(identifyChessboard(frame.nativeObjAddr, modeTakeSnapshot))
         modeTakeSnapshot = false
 
@@ -55,7 +75,170 @@ object CvCameraViewListener : CameraBridgeViewBase.CvCameraViewListener2 {
             distMat.dump())
     }
 
+    // LU-based preview that returns quickly; with refine set, the SVD solve
+    // continues in the background and is picked up with refinedCalibration().
+    // Degenerate views give an rms of NaN instead of a solution.
+    fun calibrateCameraFast(refine: Boolean = true): CameraInfo {
+
+        val matrixMat = Mat()
+        val distMat = Mat()
+
+        val report = calibrateFast(matrixMat.nativeObjAddr, distMat.nativeObjAddr, refine)
+
+        return CameraInfo(
+            matrixMat.nativeObjAddr,
+            distMat.nativeObjAddr,
+            matrixMat.dump(),
+            distMat.dump(),
+            report[0],
+            report[1])
+    }
+
+    // Null until the background refinement has finished.
+    fun refinedCalibration(): CameraInfo? {
+
+        val matrixMat = Mat()
+        val distMat = Mat()
+
+        val report = pollRefinement(matrixMat.nativeObjAddr, distMat.nativeObjAddr) ?: return null
+
+        return CameraInfo(
+            matrixMat.nativeObjAddr,
+            distMat.nativeObjAddr,
+            matrixMat.dump(),
+            distMat.dump(),
+            report[0],
+            report[1])
+    }
+
+    // Bootstrap confidence intervals for a calibration; needsMoreViews says
+    // whether further snapshots are worth taking.
+    fun calibrationUncertainty(cameraInfo: CameraInfo, samples: Int = 200): CalibrationUncertainty =
+        CalibrationUncertainty.fromArray(bootstrapCalibration(cameraInfo.matrix, cameraInfo.dist, samples))
+
+    // Pose of the board in the latest frame; call from onCameraFrame's thread.
+    fun boardPose(cameraInfo: CameraInfo): BoardPose =
+        BoardPose.fromArray(boardPose(cameraInfo.matrix, cameraInfo.dist))
+
+    // Same order as CalibrationSolver in camera_calibration.h.
+    enum class Solver { DENSE, SPARSE, MODEL_SELECTION }
+
+    // The sparse solver scales linearly with views, so it can take far more snapshots.
+    fun configureSolver(solver: Solver, maxViews: Int = if (solver == Solver.SPARSE) 500 else 20) =
+        configureCalibration(solver.ordinal, maxViews)
+
+    // Same order as TargetPattern in calibration_target.h. For circle grids the
+    // board size counts circles and the square size is the centre spacing.
+    // Switching discards the snapshots taken so far.
+    enum class Target { CHESSBOARD, SYMMETRIC_CIRCLES, ASYMMETRIC_CIRCLES }
+
+    fun configureTarget(target: Target) = configureTarget(target.ordinal)
+
+    // Same order as LensModel in camera_calibration.h. Applies to the session's
+    // calibration and undistortion; balance and fovScale only affect the fisheye view.
+    enum class Lens { PINHOLE, FISHEYE }
+
+    fun configureLens(lens: Lens, balance: Double = 0.0, fovScale: Double = 1.0) =
+        configureLensModel(lens.ordinal, balance, fovScale)
+
+    fun selectedDistortionModel(): String = distortionModel()
+
+    fun pipelineStats(): PipelineStats = PipelineStats.fromArray(getStats())
+
+    fun resetPipelineStats() = resetStats()
+
+    // Chrome trace-event JSON, viewable in chrome://tracing or ui.perfetto.dev.
+    fun startTracing(path: String): Boolean = startTrace(path)
+
+    fun stopTracing(): Long = stopTrace()
+
+    // Detects consecutive frames on several workers at once; results are shown
+    // in frame order and late ones dropped. 1 keeps detection on the camera thread.
+    fun configureDetectionWorkers(workers: Int) = configureDetection(workers)
+
+    // Frame budget for both screens; with adaptive set, detection and undistort
+    // trade quality for time when frames run over it. The current levels show
+    // up in pipelineStats().
+    fun configureFrameBudget(targetFps: Int = 30, adaptive: Boolean = false) =
+        configureFrameBudget(1_000_000L / targetFps, adaptive)
+
+    // Detection autotuning: collect preview frames with the board in view, then
+    // autotuneDetection() benchmarks detection settings on them, applies the
+    // best and saves it to `path`. Blocking; call it off the main thread.
+    // loadTunedDetection() restores it on later runs of the same device.
+    fun startTuningCapture(frames: Int = 24) = collectTuningFrames(frames)
+
+    fun tuningCaptureProgress(): Int = tuningFramesCollected()
+
+    fun autotuneDetection(path: String, device: String = Build.FINGERPRINT): DetectionTuning =
+        DetectionTuning.fromArray(nativeAutotuneDetection(path, device))
+
+    fun loadTunedDetection(path: String, device: String = Build.FINGERPRINT): Boolean =
+        loadDetectionConfig(path, device)
+
+    // Records the raw Y plane of every preview frame into a ring file of
+    // `slots` frames for replaying field issues. Frames are copied off the
+    // camera thread and dropped rather than delaying it. Call after the camera
+    // view has started; stopFrameRecording() returns the frames written.
+    fun startFrameRecording(path: String, slots: Int = 300, device: String = Build.FINGERPRINT): Boolean {
+        if (recording || frameWidth == 0)
+            return false
+        recording = startRecording(path, frameWidth, frameHeight, device, slots)
+        return recording
+    }
+
+    fun stopFrameRecording(): Long {
+        recording = false
+        return stopRecording()
+    }
+
+    // Saves the snapshots' corners, board and image size in the binary dataset
+    // format that calibration-resolve re-solves offline. Refines deferred
+    // snapshots first, so call it off the main thread.
+    fun saveCalibrationDataset(path: String, device: String = Build.FINGERPRINT): Boolean =
+        saveDataset(path, device)
+
+    // Saves the frame behind every accepted snapshot into `directory` (which
+    // must exist) on a background thread. When `capacity` frames are already
+    // waiting, the new one is dropped, or with dropOldest the oldest waiting
+    // one. A null directory stops saving.
+    fun saveSnapshotImages(directory: String?, capacity: Int = 4, dropOldest: Boolean = false,
+                           jpegQuality: Int = 90, scale: Double = 1.0, png: Boolean = false): Boolean =
+        configureSnapshotImages(directory ?: "", capacity, dropOldest, jpegQuality, scale, png)
+
+    fun snapshotImageStats(): SnapshotImageStats = SnapshotImageStats.fromArray(getSnapshotImageStats())
+
+    // Negative worker counts keep the defaults derived from the big/little core layout.
+    fun configureWorkers(latencyWorkers: Int = -1, backgroundWorkers: Int = -1, pinThreads: Boolean = true) =
+        configureThreadPool(latencyWorkers, backgroundWorkers, pinThreads)
+
     private external fun identifyChessboard(matAddr: Long, modeTakeSnapshot: Boolean): Int
     private external fun setSizes(matAddr: Long, boardWidth: Int, boardHeight: Int, squareSize: Int)
     private external fun calibrate(matrixAddr: Long, distAddr: Long)
+    private external fun calibrateFast(matrixAddr: Long, distAddr: Long, refine: Boolean): DoubleArray
+    private external fun pollRefinement(matrixAddr: Long, distAddr: Long): DoubleArray?
+    private external fun bootstrapCalibration(matrixAddr: Long, distAddr: Long, samples: Int): DoubleArray
+    private external fun boardPose(matrixAddr: Long, distAddr: Long): FloatArray
+    private external fun getStats(): DoubleArray
+    private external fun resetStats()
+    private external fun startTrace(path: String): Boolean
+    private external fun stopTrace(): Long
+    private external fun configureCalibration(solver: Int, maxViews: Int)
+    private external fun configureTarget(pattern: Int)
+    private external fun configureLensModel(lens: Int, balance: Double, fovScale: Double)
+    private external fun distortionModel(): String
+    private external fun configureDetection(workers: Int)
+    private external fun collectTuningFrames(count: Int)
+    private external fun tuningFramesCollected(): Int
+    private external fun nativeAutotuneDetection(path: String, device: String): DoubleArray
+    private external fun loadDetectionConfig(path: String, device: String): Boolean
+    private external fun configureFrameBudget(budgetUs: Long, adaptive: Boolean)
+    private external fun startRecording(path: String, width: Int, height: Int, device: String, slots: Int): Boolean
+    private external fun recordFrame(matAddr: Long, timestampNs: Long, flags: Int)
+    private external fun stopRecording(): Long
+    private external fun saveDataset(path: String, device: String): Boolean
+    private external fun configureSnapshotImages(directory: String, capacity: Int, dropOldest: Boolean,
+                                                 jpegQuality: Int, scale: Double, png: Boolean): Boolean
+    private external fun getSnapshotImageStats(): DoubleArray
+    private external fun configureThreadPool(latencyWorkers: Int, backgroundWorkers: Int, pinThreads: Boolean)
 }
\ No newline at end of file
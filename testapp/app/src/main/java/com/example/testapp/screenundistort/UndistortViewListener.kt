@@ -23,5 +23,16 @@ object UndistortViewListener : CameraBridgeViewBase.CvCameraViewListener2 {
         return frame
     }
 
+    // Raw camera pixels to undistorted-frame pixels and back, as interleaved
+    // x, y pairs. Cheaper than undistorting the frame when an overlay only
+    // needs a few points; null until a calibration and the frame size are set.
+    fun undistortPoints(points: FloatArray): FloatArray? =
+        cameraInfo?.let { undistortPoints(it.matrix, it.dist, points) }
+
+    fun distortPoints(points: FloatArray): FloatArray? =
+        cameraInfo?.let { distortPoints(it.matrix, it.dist, points) }
+
     private external fun undistort(frameAddr: Long, matrixAddr: Long, distAddr: Long)
+    private external fun undistortPoints(matrixAddr: Long, distAddr: Long, points: FloatArray): FloatArray?
+    private external fun distortPoints(matrixAddr: Long, distAddr: Long, points: FloatArray): FloatArray?
 }
\ No newline at end of file